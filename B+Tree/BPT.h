@@ -4,11 +4,17 @@
 #include <iostream>
 #include <cstring>
 #include <cmath>
-#include <fstream>
+#include <type_traits>
+#include <atomic>
 #include "../STLite/vector.hpp"
 #include "../STLite/exceptions.hpp"
+#include "storage.h"
 #include "data.h"
 #include "cache.h"
+#include "latch.h"
+#include "key.h"
+#include "page.h"
+#include "traits.h"
 
 /*
  * Class: my::BPT
@@ -17,6 +23,8 @@
  * Typical usage of which looks like this:
  *
  *    BPT<key_type, value_type> map("file");
+ *    BPT<key_type, value_type> scanned("file", CachePolicy::TwoQ); //scans do not evict hot nodes
+ *    BPT<key_type, value_type, Tuned> tuned("file"); //storage, cache, keys and values by my::TreeTraits
  *
  *    map.assign(key,value); //override if element already exists
  *
@@ -34,18 +42,33 @@
  *    void func(const key_type &,const value_type &);
  *    map.executeAll(func);
  *
+ *    for (auto it = map.lowerBound(key); it.valid(); ++it) {...} //it.key(), it.value()
+ *    for (auto it = --map.end(); it.valid(); --it) {...} //descending
+ *
+ *    bool next(key_type &, value_type &); //false at the end of a key-ascending stream
+ *    map.bulkLoad(next, 0.9); //empty map only, leaves are packed 90% full
+ *
  *    int size = map.size();
  *
+ *    map.pinInternal(64); //up to 64 pages of internal nodes never leave memory
+ *
+ * Small values are kept in the leaves themselves, large ones in "file_dataFile": by default a value
+ * stays in the leaf as long as at least 9 (key, value) entries still fit in one leaf page,
+ * decided at compile time unless the traits say otherwise (see inlineValue below and traits.h).
+ * Key types with an encode() are stored and compared as memcmp-able bytes, see key.h.
+ * Every node is one page of TICKET_NODE_PAGE bytes, the file format is described in page.h.
+ * With TICKET_CONCURRENT=1, find(), count() and [] may run on many threads next to one writer (see latch.h).
+ *
  */
 
 namespace my {
 
     using sjtu::error;
 
-    template<class K, class T>
+    template<class K, class T, class Traits = TreeTraits>
     class BPT {
     public:
-        explicit BPT(const std::string &name);
+        explicit BPT(const std::string &name, CachePolicy policy = Traits::cache); //policy of node and data caches
 
         ~BPT();
 
@@ -53,6 +76,9 @@ namespace my {
 
         bool erase(const K &key); //return false if the element not found
 
+        template<class Source>
+        void bulkLoad(Source next, double fill = 1.0); //build an empty tree bottom-up from sorted input
+
         bool find(const K &key, T &output); //return false if element no find (no change to output)
 
         T operator[](const K &key); //throw error if key no find
@@ -64,71 +90,134 @@ namespace my {
         bool empty() const { return size_ == 0; }
 
         void clear() {
-            root_pos = 0;
-            endAddress = firstNodeAddress;
-            size_ = 0;
-            data.clear();
-            cache.clear();
+            WriteGuard guard(writer, versions);
+            reset();
         }
 
         void executeAll(void (*func)(const K &key, const T &value));
 
-        long findAddress(const K &key) {
-            if (size_ == 0) return 0;
-            Node tmp;
-            findLeafNode(key, tmp);
-            int i = tmp.lowerBound(key);
-            if (tmp.k[i] != key || i == tmp.size) return 0;
-            return tmp.ptr[i];
+        class cursor;
+
+        cursor begin();
+
+        cursor end(); //one past the last element, --end() is the last one
+
+        cursor lowerBound(const K &key); //first element >= key
+
+        cursor upperBound(const K &key); //first element > key
+
+        void pinInternal(size_t pages) { cache.setPinBudget(pages); } //keep internal nodes resident, 0 to disable
+
+        void reload() { //drop everything cached and reread the file, e.g. after restoring a snapshot
+            WriteGuard guard(writer, versions);
+            reset();
+            data.reload();
+            if (file.size()) readHeader();
         }
 
-        inline void getData(long address, T &output) const { data.read(address, output); }
+        void flush() { //checkpoint: header and all dirty nodes and values reach the file
+            WriteGuard guard(writer, versions);
+            writeHeader();
+            cache.flush();
+            data.flush();
+        }
 
     private:
-        constexpr static int halfBlockSize = 2000 / (sizeof(long) + sizeof(K));
+        using Key = typename Traits::template key<K>; //what nodes keep of a key
+
+        constexpr static size_t NodeBody = NodePage - sizeof(PageHeader) - sizeof(long) * 3; //after fa, prev, next
+
+        constexpr static int halfBlockSize = ((NodeBody - sizeof(long) * 2) / (sizeof(Key) + sizeof(long)) - 1) / 2;
+        //D keys and D + 1 pointers of a non-leaf node, one long spent on alignment
 
         constexpr static int Degree = halfBlockSize << 1 | 1; //odd number required here
         //we keep one empty space for split
 
-        constexpr static int firstNodeAddress = (sizeof(long) << 1) + sizeof(int);
-        //we write root_pos, endAddress and size_ at the beginning of file
+        constexpr static bool inlineValue = Traits::values == ValuePlacement::Inline ||
+                (Traits::values == ValuePlacement::Auto &&
+                 (NodeBody - alignof(T) - 1) / (sizeof(Key) + sizeof(T) + sizeof(unsigned short)) >= 9);
+        //by default, values that still allow 9 entries per leaf are stored in the leaf, saving a read per lookup
+
+        using Slot = typename std::conditional<inlineValue, T, long>::type; //what a leaf keeps per key
+
+        constexpr static int halfLeafSize =
+                ((NodeBody - alignof(Slot) - 1) / (sizeof(Key) + sizeof(Slot) + sizeof(unsigned short)) - 1) / 2;
+
+        constexpr static int LeafDegree = halfLeafSize << 1 | 1;
+
+        static_assert(halfBlockSize >= 2 && halfLeafSize >= 2, "key too large for the node page, raise TICKET_NODE_PAGE");
+
+        constexpr static int KeySlots = Degree > LeafDegree ? Degree : LeafDegree;
+
+        constexpr static size_t PtrOffset = alignUp(sizeof(Key) * Degree, alignof(long)); //non-leaf, after k
+
+        constexpr static size_t ValOffset = alignUp(sizeof(Key) * LeafDegree, alignof(Slot)); //leaf, after k
+
+        constexpr static size_t SlotOffset = alignUp(ValOffset + sizeof(Slot) * LeafDegree, alignof(unsigned short));
+
+        static_assert(PtrOffset + sizeof(long) * (Degree + 1) <= NodeBody &&
+                      SlotOffset + sizeof(unsigned short) * LeafDegree <= NodeBody, "node overflows its page");
+
+        constexpr static long firstNodeAddress = NodePage; //page 0 holds the FileHeader, see page.h
 
         std::string filename;
-        std::fstream file;
+        Storage file; //declared before cache, which writes back through it when destroyed
 
-        long root_pos = 0;
+        std::atomic<long> root_pos{0}; //read by descend() without the writer latch
         long endAddress = firstNodeAddress;
         int size_ = 0;
+        long freeNode = 0; //head of the list of released nodes, linked through Node::fa
+        unsigned long long lsn = 0; //of the last node written
 
-        File<T> data;
-
-        struct Node {
-            bool isLeaf = true; //new created as leaf
-            int size = 0;
-            long fa = 0;
+        Latch writer; //one modifying operation at a time
+        VersionTable versions; //node versions checked by find() and count(), see latch.h
 
-            K k[Degree]{};
+        File<typename std::conditional<inlineValue, long, T>::type> data; //values, when not inline
 
-            long ptr[Degree + 1]{0}; // when the node is leaf, ptr[Degree] points to the next leaf
+        struct Node : public PageHeader { //exactly one page
+            long fa = 0;
+            long prev = 0, next = 0; //when the node is leaf, the neighbouring leaves
 
-            Node() = default;
+            union {
+                Key k[KeySlots]; //k[0..Degree) of a non-leaf, k[0..LeafDegree) of a leaf
+                unsigned char body[NodeBody]; //the arrays below follow the keys
+            };
 
-            Node(const Node &n) : size(n.size), fa(n.fa), isLeaf(n.isLeaf) {
-                memcpy(k, n.k, sizeof(K) * Degree);
-                memcpy(ptr, n.ptr, sizeof(long) * (Degree + 1));
+            Node() {
+                memset((void *) body, 0, NodeBody);
+                for (int i = 0; i < LeafDegree; ++i) slots()[i] = i;
             }
 
+            Node(const Node &n) { memcpy((void *) this, &n, sizeof(Node)); }
+
             Node &operator=(const Node &n) { //deep copy
-                if (this == &n) return *this;
-                size = n.size;
-                fa = n.fa;
-                isLeaf = n.isLeaf;
-                memcpy(k, n.k, sizeof(K) * Degree);
-                memcpy(ptr, n.ptr, sizeof(long) * (Degree + 1));
+                if (this != &n) memcpy((void *) this, &n, sizeof(Node));
                 return *this;
             }
 
-            int lowerBound(const K &key) { //return first e[i] >= key, no find then return size
+            inline bool isLeaf() const { return type == LeafPage; }
+
+            inline long *ptr() { return reinterpret_cast<long *>(body + PtrOffset); } //non-leaf: the children
+
+            inline Slot *val() { return reinterpret_cast<Slot *>(body + ValOffset); }
+            //leaf: the value itself, or its address in data, kept as a heap, see value()
+
+            inline const Slot *val() const { return reinterpret_cast<const Slot *>(body + ValOffset); }
+
+            inline unsigned short *slots() { return reinterpret_cast<unsigned short *>(body + SlotOffset); }
+            //leaf: heap places of the values of k[0..size), the free ones after
+
+            inline const unsigned short *slots() const {
+                return reinterpret_cast<const unsigned short *>(body + SlotOffset);
+            }
+
+            inline long &child(int i) { return ptr()[i]; }
+
+            inline Slot &value(int i) { return val()[slots()[i]]; } //leaf: what belongs to k[i]
+
+            inline const Slot &value(int i) const { return val()[slots()[i]]; }
+
+            int lowerBound(const Key &key) { //return first e[i] >= key, no find then return size
                 int l = 0, r = size - 1, mid;
                 while (l <= r) {
                     mid = (l + r) >> 1;
@@ -138,7 +227,7 @@ namespace my {
                 return l;
             }
 
-            int upperBound(const K &key) { //return first e[i] > key, no find then return size
+            int upperBound(const Key &key) { //return first e[i] > key, no find then return size
                 int l = 0, r = size - 1, mid;
                 while (l <= r) {
                     mid = (l + r) >> 1;
@@ -148,7 +237,7 @@ namespace my {
                 return l;
             }
 
-            bool find(const K &key) {
+            bool find(const Key &key) {
                 int i = lowerBound(key);
                 if (i == size) return false;
                 return k[i] == key;
@@ -158,220 +247,421 @@ namespace my {
         Cache<Node> cache;
 
         inline void readNode(long address, Node &node) {
-            node = cache[address];
+            cache.read(address, node);
+            if (node.type == InternalPage) cache.pin(address, true);
+        }
+
+        inline void writeNode(long address, Node &node) { //dirty until evicted or flushed
+            versions.lock(address); //odd until the operation ends, readers holding a copy restart
+            node.lsn = ++lsn;
+            cache.put(address, node);
+            cache.pin(address, node.type == InternalPage);
+        }
+
+        inline Node root() {
+            Node node;
+            cache.read(root_pos, node);
+            return node;
+        }
+
+        inline void setRoot(long address) { //readers check the root pointer under address 0
+            versions.lock(0);
+            root_pos.store(address, std::memory_order_release);
+        }
+
+        void reset() { //clear() with the writer latch held
+            versions.lockAll();
+            root_pos = 0;
+            endAddress = firstNodeAddress;
+            freeNode = 0;
+            size_ = 0;
+            data.clear();
+            cache.clear();
+        }
+
+        inline void readValue(const Node &leaf, int i, T &output) {
+            if constexpr (inlineValue) output = leaf.value(i);
+            else data.read(leaf.value(i), output);
+        }
+
+        inline void newValue(Node &leaf, int i, const T &value) { //fill an empty slot
+            if constexpr (inlineValue) leaf.value(i) = value;
+            else leaf.value(i) = data.add(value);
+        }
+
+        inline void replaceValue(Node &leaf, int i, const T &value) {
+            if constexpr (inlineValue) leaf.value(i) = value;
+            else data.write(leaf.value(i), value);
+        }
+
+        inline void dropValue(Node &leaf, int i) {
+            if constexpr (!inlineValue) data.del(leaf.value(i));
         }
 
-        inline void writeNode(long address, const Node &node) {
-            if (cache.has(address))
-                cache.get(address) = node;
-            else {
-                file.seekp(address);
-                file.write(reinterpret_cast<const char *>(&node), sizeof(Node));
-                cache.addNew(address,node);
+        static FileHeader format() { return FileHeader(MapTree, sizeof(Key), sizeof(Slot)); }
+
+        void readHeader() {
+            FileHeader header;
+            file.read(0, &header, sizeof(FileHeader));
+            header.check(filename, format());
+            root_pos = header.root;
+            endAddress = header.end;
+            size_ = header.size;
+            freeNode = header.freeNode;
+            lsn = header.lsn;
+        }
+
+        void writeHeader() {
+            FileHeader header = format();
+            header.root = root_pos;
+            header.end = endAddress;
+            header.size = size_;
+            header.freeNode = freeNode;
+            header.lsn = lsn;
+            file.write(0, &header, sizeof(FileHeader));
+        }
+
+        long allocNode() { //reuse a released node if there is one
+            if (!freeNode) {
+                endAddress += sizeof(Node);
+                return endAddress - sizeof(Node);
             }
+            long address = freeNode;
+            versions.lock(address); //a reader may still follow a stale pointer to it
+            Node node;
+            cache.read(address, node);
+            freeNode = node.fa;
+            return address;
         }
 
-        inline Node root() { return cache[root_pos]; }
+        void releaseNode(long address) {
+            Node node;
+            node.type = FreePage;
+            node.fa = freeNode;
+            writeNode(address, node);
+            freeNode = address;
+        }
 
-        long findLeafNode(const K &key, Node &node) { //get required node in node
+        long findLeafNode(const Key &key, Node &node) { //get required node in node
             if (size_ == 0) {
                 node = Node();
                 return 0;
             }
             long addr = root_pos; //always points to the address of node
             readNode(addr, node);
-            while (!node.isLeaf) {
-                addr = node.ptr[node.upperBound(key)];
+            while (!node.isLeaf()) {
+                addr = node.child(node.upperBound(key));
                 readNode(addr, node);
             }
             return addr; //if root is leaf, return root_pos
         }
 
-        void insertInternal(long curAddr, long rightAddr, const K &key);
+        bool descend(const Key &key, Node &node, long &addr, unsigned long long &version) {
+            //findLeafNode() for readers, false if a writer got in the way
+            unsigned long long top = versions.stable(0);
+            addr = root_pos.load(std::memory_order_acquire);
+            if (!addr) {
+                node = Node();
+                return versions.validate(0, top);
+            }
+            version = versions.stable(addr);
+            readNode(addr, node);
+            if (!versions.validate(addr, version) || !versions.validate(0, top)) return false;
+            while (!node.isLeaf()) {
+                long son = node.child(node.upperBound(key));
+                unsigned long long v = versions.stable(son);
+                if (!versions.validate(addr, version)) return false; //son may be stale
+                readNode(son, node);
+                if (!versions.validate(son, v)) return false;
+                addr = son, version = v;
+            }
+            return true;
+        }
+
+        void insertInternal(long curAddr, long rightAddr, const Key &key);
+
+        void linkPrev(long address, long prev_pos) { //make the leaf at address point back to prev_pos
+            if (!address) return;
+            Node node;
+            readNode(address, node);
+            node.prev = prev_pos;
+            writeNode(address, node);
+        }
 
         static inline void removeLeafVal(int index, Node &node) { //remove element[index] from a leaf node
             if (node.size == 0) return;
-            for (int i = index; i < node.size - 1; ++i) {
-                node.k[i] = node.k[i + 1];
-                node.ptr[i] = node.ptr[i + 1];
-            }
-            node.ptr[--node.size] = 0;
+            for (int i = index; i < node.size - 1; ++i) node.k[i] = node.k[i + 1];
+            unsigned short place = node.slots()[index]; //values stay where they are, only slots move
+            memmove(node.slots() + index, node.slots() + index + 1, sizeof(unsigned short) * (node.size - index - 1));
+            node.slots()[--node.size] = place; //free again
+        }
+
+        static inline void openLeafVal(int index, Node &node) { //make room for element[index] in a leaf, size + 1
+            for (int i = node.size; i > index; --i) node.k[i] = node.k[i - 1];
+            unsigned short place = node.slots()[node.size]; //the first free place
+            memmove(node.slots() + index + 1, node.slots() + index, sizeof(unsigned short) * (node.size - index));
+            node.slots()[index] = place;
+            ++node.size;
         }
 
         static inline void mergeLeafNode(Node &left, const Node &right) { //merge right node to left
             //node right remain unchanged, which is going to be discarded
             for (int j = 0; j < right.size; ++j) {
                 left.k[left.size + j] = right.k[j];
-                left.ptr[left.size + j] = right.ptr[j];
+                left.value(left.size + j) = right.value(j);
             }
             left.size += right.size;
-            left.ptr[Degree] = right.ptr[Degree];
+            left.next = right.next;
         }
 
         void eraseAdjust(long address, Node &node);
 
         void eraseAdjustInternal(long address, Node &node);
 
+        static int fillSize(double fill, int least, int most) { //entries per node for a fill factor
+            int n = (int) (fill * most);
+            return n < least ? least : (n > most ? most : n);
+        }
+
+        static int groupCount(int n, int per, int least) { //split n children evenly, at least least each
+            int m = (n + per - 1) / per;
+            if (m > 1 && n / m < least) m = n / least;
+            return m;
+        }
+
     };
 
-    template<class K, class T>
-    void BPT<K, T>::executeAll(void (*func)(const K &, const T &)) {
-        if (size_ == 0) return;
-        Node tmp = root();
-        int v;
-        while (!tmp.isLeaf)
-            readNode(tmp.ptr[0], tmp);
-        //now tmp is the first leaf
-        for (int i = 0; i < tmp.size; ++i) {
-            data.read(tmp.ptr[i], v);
-            func(tmp.k[i], v);
+    template<class K, class T, class Traits>
+    void BPT<K, T, Traits>::executeAll(void (*func)(const K &, const T &)) {
+        for (cursor it = begin(); it.valid(); ++it) func(it.key(), it.value());
+    }
+
+    /*
+     * Class: my::BPT::cursor
+     * ---------------------
+     * A position in the leaf chain, which walks both ways through the next/prev links.
+     * The cursor keeps a copy of its leaf and reads a value only when asked,
+     * so it must not be used after the tree is modified.
+     * Stepping past either end leaves it invalid.
+     */
+    template<class K, class T, class Traits>
+    class BPT<K, T, Traits>::cursor {
+    public:
+        bool valid() const { return pos && i >= 0 && i < node.size; }
+
+        K key() const { return node.k[i]; } //nodes may keep only an encoding of it
+
+        T value() const {
+            T output;
+            tree->readValue(node, i, output);
+            return output;
+        }
+
+        cursor &operator++() {
+            if (!pos || i >= node.size) return *this;
+            if (++i == node.size) forward();
+            return *this;
         }
-        while (tmp.ptr[Degree]) {
-            readNode(tmp.ptr[Degree], tmp);
-            for (int i = 0; i < tmp.size; ++i) {
-                data.read(tmp.ptr[i], v);
-                func(tmp.k[i], v);
+
+        cursor &operator--() {
+            if (!pos || i < 0) return *this;
+            if (--i < 0 && node.prev) {
+                pos = node.prev;
+                tree->readNode(pos, node);
+                i = node.size - 1;
             }
+            return *this;
         }
-    }
 
-    //-----------------------------------core implement--------------------------------------------
+    private:
+        friend class BPT<K, T, Traits>;
 
+        BPT *tree;
+        Node node;
+        long pos = 0; //0 for an empty tree
+        int i = 0;
+
+        cursor(BPT *t, long p, const Node &n, int index) : tree(t), node(n), pos(p), i(index) {
+            if (pos && i == node.size) forward();
+        }
+
+        void forward() { //i has run off the end of this leaf, move to the next one if any
+            if (!node.next) return;
+            pos = node.next;
+            tree->readNode(pos, node);
+            i = 0;
+        }
+    };
+
+    template<class K, class T, class Traits>
+    typename BPT<K, T, Traits>::cursor BPT<K, T, Traits>::begin() {
+        if (size_ == 0) return cursor(this, 0, Node(), 0);
+        Node tmp = root();
+        long addr = root_pos;
+        while (!tmp.isLeaf()) {
+            addr = tmp.child(0);
+            readNode(addr, tmp);
+        }
+        return cursor(this, addr, tmp, 0);
+    }
 
-    template<class K, class T>
-    BPT<K, T>::BPT(const std::string &name):data(name + "_dataFile"), filename(name) { //open file
-        file.open(name);
-        if (file) {
-            file.seekg(0);
-            file.read(reinterpret_cast<char *>(&root_pos), sizeof(long));
-            file.read(reinterpret_cast<char *>(&endAddress), sizeof(long));
-            file.read(reinterpret_cast<char *>(&size_), sizeof(int));
-        } else { //create new file, root_pos = 0
-            file.open(name, std::ios::out);
-            file.seekp(0);
-            file.write(reinterpret_cast<char *>(&root_pos), sizeof(long));
-            file.write(reinterpret_cast<char *>(&endAddress), sizeof(long));
-            file.write(reinterpret_cast<char *>(&size_), sizeof(int));
-            file.close();
-            file.open(name);
-        }
-        cache.init(name);
-        if(root_pos) cache.getNew(root_pos);
+    template<class K, class T, class Traits>
+    typename BPT<K, T, Traits>::cursor BPT<K, T, Traits>::end() {
+        if (size_ == 0) return cursor(this, 0, Node(), 0);
+        Node tmp = root();
+        long addr = root_pos;
+        while (!tmp.isLeaf()) {
+            addr = tmp.child(tmp.size);
+            readNode(addr, tmp);
+        }
+        return cursor(this, addr, tmp, tmp.size);
     }
 
-    template<class K, class T>
-    BPT<K, T>::~BPT() {
-        file.seekp(0);
-        file.write(reinterpret_cast<char *>(&root_pos), sizeof(long));
-        file.write(reinterpret_cast<char *>(&endAddress), sizeof(long));
-        file.write(reinterpret_cast<char *>(&size_), sizeof(int));
-        file.close();
+    template<class K, class T, class Traits>
+    typename BPT<K, T, Traits>::cursor BPT<K, T, Traits>::lowerBound(const K &key) {
+        const Key probe(key);
+        Node tmp;
+        long addr = findLeafNode(probe, tmp);
+        return cursor(this, addr, tmp, tmp.lowerBound(probe));
     }
 
-    template<class K, class T>
-    bool BPT<K, T>::find(const K &key, T &output) {
-        if (size_ == 0) return false;
+    template<class K, class T, class Traits>
+    typename BPT<K, T, Traits>::cursor BPT<K, T, Traits>::upperBound(const K &key) {
+        const Key probe(key);
         Node tmp;
-        findLeafNode(key, tmp);
-        int i = tmp.lowerBound(key);
-        if (tmp.k[i] != key || i == tmp.size) return false;
-        data.read(tmp.ptr[i], output);
-        return true;
+        long addr = findLeafNode(probe, tmp);
+        return cursor(this, addr, tmp, tmp.upperBound(probe));
+    }
+
+    //-----------------------------------core implement--------------------------------------------
+
+
+    template<class K, class T, class Traits>
+    BPT<K, T, Traits>::BPT(const std::string &name, CachePolicy policy):filename(name), file(name, Traits::storage()),
+                                                                   data(name + "_dataFile", policy,
+                                                                        Traits::storage()) { //open file
+        if (file.size()) readHeader();
+        else writeHeader(); //create new file, root_pos = 0
+        cache.init(file, policy);
+        if (Traits::pinPages) cache.setPinBudget(Traits::pinPages);
+        if (root_pos) root(); //warm the cache
     }
 
-    template<class K, class T>
-    T BPT<K, T>::operator[](const K &key) {
-        if (size_ == 0) error("invalid use of BPT[] when empty)");
+    template<class K, class T, class Traits>
+    BPT<K, T, Traits>::~BPT() { writeHeader(); }
+
+    template<class K, class T, class Traits>
+    bool BPT<K, T, Traits>::find(const K &key, T &output) {
+        const Key probe(key); //prefix computed once for the whole descent
         Node tmp;
-        findLeafNode(key, tmp);
-        int i = tmp.lowerBound(key);
-        if (tmp.k[i] != key || i == tmp.size) error("invalid use of BPT[] with key not exists");
+        long addr;
+        unsigned long long version;
+        while (true) {
+            if (!descend(probe, tmp, addr, version)) continue;
+            int i = tmp.lowerBound(probe);
+            if (!addr || tmp.k[i] != probe || i == tmp.size) return false;
+            if constexpr (concurrent && !inlineValue) { //the value may be released as soon as the leaf changes
+                T value;
+                readValue(tmp, i, value);
+                if (!versions.validate(addr, version)) continue;
+                output = value;
+            } else readValue(tmp, i, output);
+            return true;
+        }
+    }
+
+    template<class K, class T, class Traits>
+    T BPT<K, T, Traits>::operator[](const K &key) {
         T output;
-        data.read(tmp.ptr[i], output);
+        if (!find(key, output))
+            error(empty() ? "invalid use of BPT[] when empty)" : "invalid use of BPT[] with key not exists");
         return output;
     }
 
-    template<class K, class T>
-    bool BPT<K, T>::count(const K &key) {
-        if (size_ == 0) return false;
+    template<class K, class T, class Traits>
+    bool BPT<K, T, Traits>::count(const K &key) {
+        const Key probe(key);
         Node tmp;
-        findLeafNode(key, tmp);
-        return tmp.find(key);
+        long addr;
+        unsigned long long version;
+        while (!descend(probe, tmp, addr, version));
+        return addr && tmp.find(probe);
     }
 
-    template<class K, class T>
-    void BPT<K, T>::assign(const K &key, const T &value) {
+    template<class K, class T, class Traits>
+    void BPT<K, T, Traits>::assign(const K &key, const T &value) {
+        WriteGuard guard(writer, versions);
         if (root_pos == 0) { //empty Tree
             Node root;
             root.fa = 0;
             root.size = 1;
             root.k[0] = key;
-            root.ptr[0] = data.add(value);
-            root_pos = firstNodeAddress;
+            newValue(root, 0, value);
+            setRoot(allocNode());
             writeNode(root_pos, root);
             size_ = 1;
-            endAddress += sizeof(Node);
             return;
         }
+        const Key probe(key);
         Node tmp;
-        long tmp_pos = findLeafNode(key, tmp);
+        long tmp_pos = findLeafNode(probe, tmp);
 
-        int i = tmp.lowerBound(key);
-        if (tmp.k[i] == key && i != tmp.size) { //key already exist
-            data.write(tmp.ptr[i], value); //replace
+        int i = tmp.lowerBound(probe);
+        if (tmp.k[i] == probe && i != tmp.size) { //key already exist
+            replaceValue(tmp, i, value);
+            if constexpr (inlineValue) writeNode(tmp_pos, tmp);
             return;
         } else size_++; //insert new element
 
-        for (int j = tmp.size; j > i; --j) { //size not updated
-            tmp.k[j] = tmp.k[j - 1];
-            tmp.ptr[j] = tmp.ptr[j - 1];
-        }
-        tmp.k[i] = key;
-        tmp.ptr[i] = data.add(value);
-        tmp.size++;
+        openLeafVal(i, tmp);
+        tmp.k[i] = probe;
+        newValue(tmp, i, value);
 
-        if (tmp.size < Degree) {
+        if (tmp.size < LeafDegree) {
             writeNode(tmp_pos, tmp);
         } else { //we have to split the node now
             Node newLeaf; //at right
-            newLeaf.size = tmp.size - halfBlockSize;
-            tmp.size = halfBlockSize;
+            newLeaf.size = tmp.size - halfLeafSize;
+            tmp.size = halfLeafSize;
             for (int j = 0; j < newLeaf.size; ++j) {
-                newLeaf.k[j] = tmp.k[halfBlockSize + j];
-                newLeaf.ptr[j] = tmp.ptr[halfBlockSize + j];
+                newLeaf.k[j] = tmp.k[halfLeafSize + j];
+                newLeaf.value(j) = tmp.value(halfLeafSize + j);
             }
             newLeaf.fa = tmp.fa;
-            newLeaf.ptr[Degree] = tmp.ptr[Degree];
-            writeNode(endAddress, newLeaf);
-            tmp.ptr[Degree] = endAddress;
+            newLeaf.next = tmp.next;
+            newLeaf.prev = tmp_pos;
+            long newPos = allocNode();
+            writeNode(newPos, newLeaf);
+            linkPrev(newLeaf.next, newPos);
+            tmp.next = newPos;
             writeNode(tmp_pos, tmp);
-            endAddress += sizeof(Node);
-            insertInternal(tmp.fa, tmp.ptr[Degree], newLeaf.k[0]);
+            insertInternal(tmp.fa, newPos, newLeaf.k[0]);
         }
     }
 
-    template<class K, class T>
-    void BPT<K, T>::insertInternal(long curAddr, long rightAddr, const K &key) {
+    template<class K, class T, class Traits>
+    void BPT<K, T, Traits>::insertInternal(long curAddr, long rightAddr, const Key &key) {
         if (curAddr == 0) { //new root
             Node newNode;
             newNode.size = 1;
-            newNode.isLeaf = false;
+            newNode.type = InternalPage;
             newNode.k[0] = key;
-            newNode.ptr[0] = root_pos;
-            newNode.ptr[1] = rightAddr;
+            newNode.child(0) = root_pos;
+            newNode.child(1) = rightAddr;
+            long newPos = allocNode();
 
             Node rightNode;
             readNode(rightAddr, rightNode);
-            rightNode.fa = endAddress;
+            rightNode.fa = newPos;
+            newNode.level = rightNode.level + 1;
             writeNode(rightAddr, rightNode);
             //
             Node oldRoot = root();
-            oldRoot.fa = endAddress;
+            oldRoot.fa = newPos;
             writeNode(root_pos, oldRoot);
             //
-            root_pos = endAddress;
+            setRoot(newPos);
             writeNode(root_pos, newNode);
-            endAddress += sizeof(Node);
             return;
         }
         Node curNode;
@@ -385,62 +675,159 @@ namespace my {
 
         for (int j = curNode.size; j > i; --j) {
             curNode.k[j] = curNode.k[j - 1];
-            curNode.ptr[j + 1] = curNode.ptr[j];
+            curNode.child(j + 1) = curNode.child(j);
         }
         curNode.k[i] = key;
-        curNode.ptr[i + 1] = rightAddr;
+        curNode.child(i + 1) = rightAddr;
         curNode.size++;
 
         if (curNode.size < Degree)
             writeNode(curAddr, curNode);
         else { //split interval node
             Node newNode;
-            newNode.isLeaf = false; //not leaf node!
-            K newKey = curNode.k[halfBlockSize];
+            newNode.type = InternalPage; //not leaf node!
+            newNode.level = curNode.level;
+            Key newKey = curNode.k[halfBlockSize];
             newNode.size = curNode.size - halfBlockSize - 1;
             curNode.size = halfBlockSize;
             newNode.fa = curNode.fa;
             for (int j = 0; j < newNode.size; ++j) {
                 newNode.k[j] = curNode.k[halfBlockSize + 1 + j];
-                newNode.ptr[j] = curNode.ptr[halfBlockSize + 1 + j];
+                newNode.child(j) = curNode.child(halfBlockSize + 1 + j);
                 curNode.k[halfBlockSize + 1 + j] = K();
-                curNode.ptr[halfBlockSize + 1 + j] = 0;
+                curNode.child(halfBlockSize + 1 + j) = 0;
             }
-            newNode.ptr[newNode.size] = curNode.ptr[Degree];
-            curNode.ptr[Degree] = 0;
+            newNode.child(newNode.size) = curNode.child(Degree);
+            curNode.child(Degree) = 0;
             curNode.k[halfBlockSize] = K();
 
+            long newPos = allocNode();
             Node son; //debug: don't forget to change son's father!
             for (int j = 0; j <= newNode.size; ++j) {
-                readNode(newNode.ptr[j], son);
-                son.fa = endAddress;
-                writeNode(newNode.ptr[j], son);
+                readNode(newNode.child(j), son);
+                son.fa = newPos;
+                writeNode(newNode.child(j), son);
             }
 
-            writeNode(endAddress, newNode);
-            endAddress += sizeof(Node);
+            writeNode(newPos, newNode);
             writeNode(curAddr, curNode);
-            insertInternal(curNode.fa, endAddress - sizeof(Node), newKey);
+            insertInternal(curNode.fa, newPos, newKey);
+        }
+    }
+
+    template<class K, class T, class Traits>
+    template<class Source>
+    void BPT<K, T, Traits>::bulkLoad(Source next, double fill) {
+        WriteGuard guard(writer, versions);
+        if (size_) error("invalid use of BPT bulkLoad when not empty");
+        reset();
+        int leafSize = fillSize(fill, halfLeafSize, LeafDegree - 1);
+        sjtu::vector<Key> keys; //the smallest key under every node of the level built last
+        sjtu::vector<long> addrs;
+        Node prev, cur; //the last two leaves stay in memory, so that the last one can be evened out
+        long prev_pos = 0, cur_pos = 0;
+        K key;
+        T value;
+        while (next(key, value)) {
+            const Key probe(key); //nodes may keep only an encoding or a prefixed copy of the key
+            if (size_ && !(probe > cur.k[cur.size - 1])) {
+                if (probe == cur.k[cur.size - 1]) { //same as assign: the later value wins
+                    replaceValue(cur, cur.size - 1, value);
+                    continue;
+                }
+                reset();
+                error("BPT bulkLoad: keys not in ascending order");
+            }
+            if (!cur_pos) cur_pos = allocNode();
+            else if (cur.size == leafSize) { //start a new leaf
+                long newPos = allocNode();
+                cur.next = newPos;
+                if (prev_pos) {
+                    writeNode(prev_pos, prev);
+                    keys.push_back(prev.k[0]);
+                    addrs.push_back(prev_pos);
+                }
+                prev = cur, prev_pos = cur_pos;
+                cur = Node(), cur_pos = newPos;
+                cur.prev = prev_pos;
+            }
+            cur.k[cur.size] = probe;
+            newValue(cur, cur.size++, value);
+            ++size_;
+        }
+        if (size_ == 0) return;
+        if (prev_pos && cur.size < halfLeafSize) { //the last leaf is too small
+            if (prev.size + cur.size < LeafDegree) {
+                mergeLeafNode(prev, cur);
+                releaseNode(cur_pos);
+                cur_pos = 0;
+            } else {
+                while (cur.size < halfLeafSize) {
+                    openLeafVal(0, cur);
+                    --prev.size;
+                    cur.k[0] = prev.k[prev.size];
+                    cur.value(0) = prev.value(prev.size);
+                }
+            }
         }
+        if (prev_pos) {
+            writeNode(prev_pos, prev);
+            keys.push_back(prev.k[0]);
+            addrs.push_back(prev_pos);
+        }
+        if (cur_pos) {
+            writeNode(cur_pos, cur);
+            keys.push_back(cur.k[0]);
+            addrs.push_back(cur_pos);
+        }
+        int fanout = fillSize(fill, halfBlockSize, Degree - 1) + 1;
+        while (addrs.size() > 1) { //build the level above
+            sjtu::vector<Key> upKeys;
+            sjtu::vector<long> upAddrs;
+            int n = (int) addrs.size(), m = groupCount(n, fanout, halfBlockSize + 1);
+            for (int g = 0, j = 0; g < m; ++g) {
+                int cnt = n / m + (g < n % m);
+                Node node, son;
+                node.type = InternalPage;
+                node.size = cnt - 1;
+                long pos = allocNode();
+                upKeys.push_back(keys[j]);
+                upAddrs.push_back(pos);
+                for (int c = 0; c < cnt; ++c, ++j) {
+                    if (c) node.k[c - 1] = keys[j];
+                    node.child(c) = addrs[j];
+                    readNode(addrs[j], son);
+                    son.fa = pos;
+                    node.level = son.level + 1;
+                    writeNode(addrs[j], son);
+                }
+                writeNode(pos, node);
+            }
+            keys = upKeys;
+            addrs = upAddrs;
+        }
+        setRoot(addrs[0]);
     }
 
-    template<class K, class T>
-    bool BPT<K, T>::erase(const K &key) {
+    template<class K, class T, class Traits>
+    bool BPT<K, T, Traits>::erase(const K &key) {
+        WriteGuard guard(writer, versions);
         if (size_ == 0) return false;
+        const Key probe(key);
         Node tmp;
-        long tmp_pos = findLeafNode(key, tmp); //tmp is a leaf node
-        int i = tmp.lowerBound(key);
-        if (tmp.k[i] != key || i == tmp.size) return false; //element no found
+        long tmp_pos = findLeafNode(probe, tmp); //tmp is a leaf node
+        int i = tmp.lowerBound(probe);
+        if (tmp.k[i] != probe || i == tmp.size) return false; //element no found
         else { //tmp.k[i] = key
             size_--;
-            //data.delete(tmp.ptr[i])
             if (size_ == 0) { //clear tree
-                root_pos = 0;
-                endAddress = firstNodeAddress;
+                reset();
                 return true;
             }
+            versions.lock(tmp_pos); //before the value goes, readers may still hold this leaf
+            dropValue(tmp, i);
             removeLeafVal(i, tmp);
-            if (tmp.size >= halfBlockSize || tmp_pos == root_pos) {
+            if (tmp.size >= halfLeafSize || tmp_pos == root_pos) {
                 writeNode(tmp_pos, tmp);
                 return true;
             }
@@ -449,20 +836,20 @@ namespace my {
         }
     }
 
-    template<class K, class T>
-    void BPT<K, T>::eraseAdjust(long address, BPT::Node &node) { //node is a leaf and not a root
+    template<class K, class T, class Traits>
+    void BPT<K, T, Traits>::eraseAdjust(long address, BPT::Node &node) { //node is a leaf and not a root
         Node faNode;
         readNode(node.fa, faNode);
         int i = faNode.upperBound(node.k[0]) - 1; //maybe -1
         long right_pos = 0, left_pos = 0;
-        if (i != faNode.size - 1) right_pos = faNode.ptr[i + 2];
-        if (i >= 0) left_pos = faNode.ptr[i];
+        if (i != faNode.size - 1) right_pos = faNode.child(i + 2);
+        if (i >= 0) left_pos = faNode.child(i);
         Node rightNode;
         if (right_pos) { //check if borrow from the right available
             readNode(right_pos, rightNode);
-            if (rightNode.size > halfBlockSize) { //borrow successfully
+            if (rightNode.size > halfLeafSize) { //borrow successfully
                 node.k[node.size] = rightNode.k[0];
-                node.ptr[node.size] = rightNode.ptr[0];
+                node.value(node.size) = rightNode.value(0);
                 node.size++;
                 removeLeafVal(0, rightNode);
                 faNode.k[i + 1] = rightNode.k[0];
@@ -475,14 +862,11 @@ namespace my {
         Node leftNode;
         if (left_pos) { //check if borrow from the left available
             readNode(left_pos, leftNode);
-            if (leftNode.size > halfBlockSize) { //borrow successfully
-                for (int j = node.size++; j > 0; --j) {
-                    node.k[j] = node.k[j - 1];
-                    node.ptr[j] = node.ptr[j - 1];
-                }
+            if (leftNode.size > halfLeafSize) { //borrow successfully
+                openLeafVal(0, node);
                 leftNode.size--;
                 node.k[0] = leftNode.k[leftNode.size];
-                node.ptr[0] = leftNode.ptr[leftNode.size];
+                node.value(0) = leftNode.value(leftNode.size);
                 faNode.k[i] = node.k[0];
                 writeNode(node.fa, faNode);
                 writeNode(address, node);
@@ -496,24 +880,26 @@ namespace my {
             mergeLeafNode(node, rightNode);
             for (int j = i + 1; j < faNode.size - 1; ++j) {
                 faNode.k[j] = faNode.k[j + 1];
-                faNode.ptr[j + 1] = faNode.ptr[j + 2];
+                faNode.child(j + 1) = faNode.child(j + 2);
             }
             --faNode.size;
-            faNode.ptr[faNode.size + 1] = 0;
+            faNode.child(faNode.size + 1) = 0;
             writeNode(node.fa, faNode);
             writeNode(address, node);
-            //writeNode(right_pos, Node());
+            releaseNode(right_pos);
+            linkPrev(node.next, address);
         } else if (left_pos) {
             mergeLeafNode(leftNode, node);
             for (int j = i; j < faNode.size - 1; ++j) {
                 faNode.k[j] = faNode.k[j + 1];
-                faNode.ptr[j + 1] = faNode.ptr[j + 2];
+                faNode.child(j + 1) = faNode.child(j + 2);
             }
             --faNode.size;
-            faNode.ptr[faNode.size + 1] = 0;
+            faNode.child(faNode.size + 1) = 0;
             writeNode(node.fa, faNode);
             writeNode(left_pos, leftNode);
-            //writeNode(address, Node());
+            releaseNode(address);
+            linkPrev(leftNode.next, left_pos);
         } else {
             std::cout << "BPT erase adjust error: no siblings" << std::endl;
             throw sjtu::bpt_error();
@@ -521,21 +907,21 @@ namespace my {
         eraseAdjustInternal(node.fa, faNode); //faNode size -1
     }
 
-    template<class K, class T>
-    void BPT<K, T>::eraseAdjustInternal(long address, BPT::Node &node) {
+    template<class K, class T, class Traits>
+    void BPT<K, T, Traits>::eraseAdjustInternal(long address, BPT::Node &node) {
         if (node.fa == 0) { //root node
             if (root_pos != address) {
                 std::cout << "BPT erase adjust internal error: root chaos" << std::endl;
                 throw sjtu::bpt_error();
             } //safety check
             if (node.size == 0) { //erase empty root
-                root_pos = node.ptr[0];
+                setRoot(node.child(0));
                 Node newRoot;
                 readNode(root_pos, newRoot);
                 newRoot.fa = 0;
                 //no need to change isLeaf
                 writeNode(root_pos, newRoot);
-                //writeNode(address, Node());
+                releaseNode(address);
             }
             return;
         }
@@ -545,28 +931,28 @@ namespace my {
         readNode(node.fa, faNode);
         int i = faNode.upperBound(node.k[0]) - 1; //maybe -1
         long right_pos = 0, left_pos = 0;
-        if (i != faNode.size - 1) right_pos = faNode.ptr[i + 2];
-        if (i >= 0) left_pos = faNode.ptr[i];
+        if (i != faNode.size - 1) right_pos = faNode.child(i + 2);
+        if (i >= 0) left_pos = faNode.child(i);
         Node rightNode;
         if (right_pos) { //check if borrow from the right available
             readNode(right_pos, rightNode);
             if (rightNode.size > halfBlockSize) { //borrow successfully
                 Node son;
-                readNode(rightNode.ptr[0], son);
+                readNode(rightNode.child(0), son);
                 node.k[node.size++] = faNode.k[i + 1]; //not rightNode.k[0]
-                node.ptr[node.size] = rightNode.ptr[0];
+                node.child(node.size) = rightNode.child(0);
                 son.fa = address;
                 faNode.k[i + 1] = rightNode.k[0];
                 for (int j = 1; j <= rightNode.size; ++j) {
                     rightNode.k[j - 1] = rightNode.k[j];
-                    rightNode.ptr[j - 1] = rightNode.ptr[j];
+                    rightNode.child(j - 1) = rightNode.child(j);
                 }
-                rightNode.ptr[rightNode.size--] = 0;
+                rightNode.child(rightNode.size--) = 0;
 
                 writeNode(node.fa, faNode);
                 writeNode(address, node);
                 writeNode(right_pos, rightNode);
-                writeNode(node.ptr[node.size], son);
+                writeNode(node.child(node.size), son);
                 return;
             }
         }
@@ -575,25 +961,25 @@ namespace my {
             readNode(left_pos, leftNode);
             if (leftNode.size > halfBlockSize) { //borrow successfully
                 Node son;
-                readNode(leftNode.ptr[leftNode.size], son);
-                node.ptr[node.size + 1] = node.ptr[node.size];
+                readNode(leftNode.child(leftNode.size), son);
+                node.child(node.size + 1) = node.child(node.size);
                 for (int j = node.size; j > 0; --j) {
                     node.k[j] = node.k[j - 1];
-                    node.ptr[j] = node.ptr[j - 1];
+                    node.child(j) = node.child(j - 1);
                 }
                 node.k[0] = faNode.k[i];
-                node.ptr[0] = leftNode.ptr[leftNode.size];
+                node.child(0) = leftNode.child(leftNode.size);
                 node.size++;
                 son.fa = address;
                 faNode.k[i] = leftNode.k[leftNode.size - 1];
                 leftNode.size--;
                 //leftNode.e[leftNode.size] = Element();
-                leftNode.ptr[leftNode.size + 1] = 0;
+                leftNode.child(leftNode.size + 1) = 0;
 
                 writeNode(node.fa, faNode);
                 writeNode(address, node);
                 writeNode(left_pos, leftNode);
-                writeNode(node.ptr[0], son);
+                writeNode(node.child(0), son);
                 return;
             }
         }
@@ -601,56 +987,56 @@ namespace my {
         if (right_pos) {
             //merge rightNode to node
             node.k[node.size] = faNode.k[i + 1];
-            node.ptr[node.size + 1] = rightNode.ptr[0];
+            node.child(node.size + 1) = rightNode.child(0);
             Node son;
-            readNode(rightNode.ptr[0], son);
+            readNode(rightNode.child(0), son);
             son.fa = address;
-            writeNode(rightNode.ptr[0], son);
+            writeNode(rightNode.child(0), son);
             for (int j = 0; j < rightNode.size; ++j) {
                 node.k[node.size + 1 + j] = rightNode.k[j];
-                node.ptr[node.size + 2 + j] = rightNode.ptr[j + 1];
-                readNode(rightNode.ptr[j + 1], son);
+                node.child(node.size + 2 + j) = rightNode.child(j + 1);
+                readNode(rightNode.child(j + 1), son);
                 son.fa = address;
-                writeNode(rightNode.ptr[j + 1], son);
+                writeNode(rightNode.child(j + 1), son);
             }
             node.size += rightNode.size + 1;
 
             for (int j = i + 1; j < faNode.size - 1; ++j) {
                 faNode.k[j] = faNode.k[j + 1];
-                faNode.ptr[j + 1] = faNode.ptr[j + 2];
+                faNode.child(j + 1) = faNode.child(j + 2);
             }
             --faNode.size;
             //faNode.e[faNode.size] = Element();
-            faNode.ptr[faNode.size + 1] = 0;
+            faNode.child(faNode.size + 1) = 0;
             writeNode(node.fa, faNode);
             writeNode(address, node);
-            //writeNode(right_pos, Node());
+            releaseNode(right_pos);
         } else if (left_pos) {
             leftNode.k[leftNode.size] = faNode.k[i];
-            leftNode.ptr[leftNode.size + 1] = node.ptr[0];
+            leftNode.child(leftNode.size + 1) = node.child(0);
             Node son;
-            readNode(node.ptr[0], son);
+            readNode(node.child(0), son);
             son.fa = left_pos;
-            writeNode(node.ptr[0], son);
+            writeNode(node.child(0), son);
             for (int j = 0; j < node.size; ++j) {
                 leftNode.k[leftNode.size + 1 + j] = node.k[j];
-                leftNode.ptr[leftNode.size + 2 + j] = node.ptr[j + 1];
-                readNode(node.ptr[j + 1], son);
+                leftNode.child(leftNode.size + 2 + j) = node.child(j + 1);
+                readNode(node.child(j + 1), son);
                 son.fa = left_pos;
-                writeNode(node.ptr[j + 1], son);
+                writeNode(node.child(j + 1), son);
             }
             leftNode.size += node.size + 1;
 
             for (int j = i; j < faNode.size - 1; ++j) {
                 faNode.k[j] = faNode.k[j + 1];
-                faNode.ptr[j + 1] = faNode.ptr[j + 2];
+                faNode.child(j + 1) = faNode.child(j + 2);
             }
             --faNode.size;
             //faNode.e[faNode.size] = Element();
-            faNode.ptr[faNode.size + 1] = 0;
+            faNode.child(faNode.size + 1) = 0;
             writeNode(node.fa, faNode);
             writeNode(left_pos, leftNode);
-            //writeNode(address, Node());
+            releaseNode(address);
         } else {
             std::cout << "erase adjust internal error: no siblings" << std::endl;
             throw sjtu::bpt_error();
@@ -2,29 +2,78 @@
 #define TICKET_SYSTEM_CACHE_H
 
 #include <cstring>
-#include <fstream>
 #include "../STLite/exceptions.hpp"
+#include "../STLite/algorithm.h"
+#include "storage.h"
+#include "latch.h"
 
 template<size_t N = 337>
-struct HashMapL { //hash-map: long->int
+struct HashMapL { //hash-map: long->int, buckets grow with the number of elements
 private:
-    int begin[N]{0}, next[N]{0}, val[N]{0}, waste[N]{0}, cnt = 0, waste_top = 0, size_ = 0;
-    long addr[N]{0};
+    int *begin = nullptr, *next = nullptr, *val = nullptr, *waste = nullptr;
+    long *addr = nullptr;
+    int bucket = N, cap = N, cnt = 0, waste_top = 0, size_ = 0;
+
+    inline int slot(long address) const { return (int) ((unsigned long) address % bucket); }
+
+    void grow() { //double both node space and buckets, then rehash
+        int newCap = cap << 1;
+        auto *newNext = new int[newCap + 1]{0}, *newVal = new int[newCap + 1]{0}, *newWaste = new int[newCap + 1]{0};
+        auto *newAddr = new long[newCap + 1]{0};
+        memcpy(newVal, val, sizeof(int) * (cap + 1));
+        memcpy(newAddr, addr, sizeof(long) * (cap + 1));
+        memcpy(newWaste, waste, sizeof(int) * (cap + 1));
+        delete[] next;
+        delete[] val;
+        delete[] waste;
+        delete[] addr;
+        next = newNext, val = newVal, waste = newWaste, addr = newAddr, cap = newCap;
+        delete[] begin;
+        bucket = cap | 1;
+        begin = new int[bucket]{0};
+        bool *dead = new bool[cnt + 1]{false};
+        for (int i = 1; i <= waste_top; ++i) dead[waste[i]] = true;
+        for (int i = 1; i <= cnt; ++i) {
+            if (dead[i]) continue;
+            int tmp = slot(addr[i]);
+            next[i] = begin[tmp];
+            begin[tmp] = i;
+        }
+        delete[] dead;
+    }
+
 public:
-    HashMapL() = default;
+    HashMapL() {
+        begin = new int[bucket]{0};
+        next = new int[cap + 1]{0};
+        val = new int[cap + 1]{0};
+        waste = new int[cap + 1]{0};
+        addr = new long[cap + 1]{0};
+    }
+
+    HashMapL(const HashMapL &) = delete;
+
+    HashMapL &operator=(const HashMapL &) = delete;
+
+    ~HashMapL() {
+        delete[] begin;
+        delete[] next;
+        delete[] val;
+        delete[] waste;
+        delete[] addr;
+    }
 
     inline void clear() {
-        memset(begin, 0, sizeof(begin));
-        memset(next, 0, sizeof(next));
-        memset(waste, 0, sizeof(waste));
-        memset(addr, 0, sizeof(addr));
-        //memset(val, 0, sizeof(val));
+        memset(begin, 0, sizeof(int) * bucket);
+        memset(next, 0, sizeof(int) * (cap + 1));
+        memset(waste, 0, sizeof(int) * (cap + 1));
+        memset(addr, 0, sizeof(long) * (cap + 1));
         cnt = waste_top = size_ = 0;
     }
 
     inline void insert(long address, int index) {
-        if (fulled()) sjtu::error("HashMapL insert error: fulled already");
-        int tmp = address % N;
+        if (!waste_top && cnt == cap) grow();
+        int tmp = slot(address);
         int now = waste_top ? waste[waste_top--] : ++cnt;
         val[now] = index;
         next[now] = begin[tmp];
@@ -34,7 +83,7 @@ public:
     }
 
     void del(long address, int index) {
-        int tmp = address % N, pre = 0;
+        int tmp = slot(address), pre = 0;
         for (int i = begin[tmp]; i; i = next[i]) {
             if (addr[i] == address) {
                 if (val[i] == index) { //delete i
@@ -50,144 +99,409 @@ public:
     }
 
     bool has(long address) {
-        for (int i = begin[address % N]; i; i = next[i]) if (addr[i] == address) return true;
+        for (int i = begin[slot(address)]; i; i = next[i]) if (addr[i] == address) return true;
         return false;
     }
 
     int operator[](long address) {
-        for (int i = begin[address % N]; i; i = next[i]) if (addr[i] == address) return val[i];
+        for (int i = begin[slot(address)]; i; i = next[i]) if (addr[i] == address) return val[i];
         sjtu::error("HashMapL[address] error: address no find");
+        return -1;
     }
 
-    inline bool fulled() { return size_ == N - 1; }
+    inline int size() const { return size_; }
 };
 
 template<class T>
 class Editor {
 public:
-    inline void write(long address, const T &value) {
-        file.seekp(address);
-        file.write(reinterpret_cast <const char *> (&value), sizeof(T));
+    inline void write(long address, const T &value) { file->write(address, &value, sizeof(T)); }
+
+    inline void read(long address, T &value) { file->read(address, &value, sizeof(T)); }
+
+    inline void open(my::Storage &storage) { file = &storage; }
+
+    inline void close() { file = nullptr; }
+
+private:
+    my::Storage *file = nullptr;
+};
+
+//Buffer pool shared by all caches
+
+#ifndef BUFFER_POOL_PAGES
+#define BUFFER_POOL_PAGES 1024 //default budget: 1024 pages of 4 KiB
+#endif
+
+/*
+ * Replacement policy of one Cache, the pool still picks victims globally:
+ *
+ *    LRU  - every frame in one LRU list (default)
+ *    TwoQ - 2Q: a frame first enters a probation queue (A1in) and only enters
+ *           the protected list (Am) when it is loaded again after being evicted
+ *           from probation (remembered by address in the ghost queue A1out).
+ *           Probation frames beyond a quarter of the unpinned cache are evicted before
+ *           any other frame in the pool, so one-shot scans cannot push out hot nodes.
+ *
+ * Independent of the policy, a cache may pin frames (e.g. internal tree nodes)
+ * within its own pin budget: pinned frames are never evicted and do not count
+ * against the pool. Once the pin budget is full, further frames simply stay in the pool.
+ *
+ */
+
+enum class CachePolicy { LRU, TwoQ };
+
+class CacheBase { //what BufferPool needs to know about a cache
+public:
+    constexpr static unsigned long long Hot = 1ull << 63; //rank bit of frames not on probation
+
+    virtual ~CacheBase() = default;
+
+    virtual bool victim(unsigned long long &rank) = 0; //rank of the frame to evict next (lowest goes first), false if empty
+
+    virtual void evict() = 0; //write back and drop the frame reported by victim()
+
+    virtual void flush() = 0; //write back all dirty frames
+};
+
+class BufferPool { //process-wide page budget, every Cache checks its frames out from here
+public:
+    constexpr static size_t PageSize = 4096;
+
+    my::Latch latch; //taken by every public Cache method, guards all caches and the pool
+
+    static BufferPool &instance() {
+        static BufferPool pool;
+        return pool;
+    }
+
+    void setBudget(size_t pages) { //shrink immediately if necessary
+        std::lock_guard<my::Latch> guard(latch);
+        budget = pages * PageSize;
+        makeRoom(0);
     }
 
-    inline void read(long address, T &value) {
-        file.seekg(address);
-        file.read(reinterpret_cast <char *> (&value), sizeof(T));
+    inline size_t budgetPages() const { return budget / PageSize; }
+
+    inline size_t usedBytes() const { return used; }
+
+    inline unsigned long long tick() { return ++clock; }
+
+    void attach(CacheBase *cache) {
+        std::lock_guard<my::Latch> guard(latch);
+        if (count == MaxCache) sjtu::error("BufferPool attach error: too many caches");
+        caches[count++] = cache;
     }
 
-    inline void open(const std::string &name) {
-        file.open(name);
-        if (!file) sjtu::error("editor open fail");
+    void detach(CacheBase *cache) {
+        std::lock_guard<my::Latch> guard(latch);
+        for (int i = 0; i < count; ++i)
+            if (caches[i] == cache) {
+                caches[i] = caches[--count];
+                return;
+            }
     }
 
-    inline void close() { file.close(); }
+    void acquire(size_t bytes) { //make room for a new frame, evicting the globally lowest ranked ones (latch held)
+        makeRoom(bytes);
+        used += bytes;
+    }
+
+    inline void release(size_t bytes) { used -= bytes; }
+
+    void flush() { //checkpoint: write back dirty frames of every cache
+        for (int i = 0; i < count; ++i) caches[i]->flush();
+    }
 
 private:
-    std::fstream file;
+    constexpr static int MaxCache = 64;
+
+    CacheBase *caches[MaxCache]{nullptr};
+    int count = 0;
+    size_t budget = BUFFER_POOL_PAGES * PageSize, used = 0;
+    unsigned long long clock = 0;
+
+    BufferPool() = default;
+
+    void makeRoom(size_t bytes) {
+        while (used + bytes > budget) {
+            CacheBase *target = nullptr;
+            unsigned long long lowest = 0, rank;
+            for (int i = 0; i < count; ++i)
+                if (caches[i]->victim(rank) && (!target || rank < lowest)) {
+                    target = caches[i];
+                    lowest = rank;
+                }
+            if (!target) return; //nothing left to evict
+            target->evict();
+        }
+    }
 };
 
 //Cache for file
 
-template<class T, size_t N = 36>
-class Cache { //LRU
+template<class T>
+class Cache : public CacheBase { //LRU or 2Q over frames checked out from BufferPool
 private:
+    constexpr static int Probation = 0, Protected = 1, Pinned = 2; //queues: A1in, Am (LRU uses Protected only) and pinned
+    constexpr static int GhostSize = 512; //addresses remembered in A1out
+
     HashMapL<> index;
-    T val[N]{};
-    int head = -1, tail = -1, size = 0, pre[N]{0}, to[N]{0};
-    long pos[N]{0}; //address of val[i]
+    T **val = nullptr; //val[i] is allocated only while frame i is in use
+    long *pos = nullptr; //address of val[i]
+    unsigned long long *stamp = nullptr; //last access of val[i]
+    bool *dirty = nullptr; //val[i] differs from the file
+    int *pre = nullptr, *to = nullptr, *queue = nullptr, *spare = nullptr;
+    int head[3]{-1, -1, -1}, tail[3]{-1, -1, -1}, count[3]{0, 0, 0};
+    int size = 0, cap = 0, spare_top = 0;
+    size_t pinBudget = 0, pinnedBytes = 0; //pinned frames live outside the pool budget
+    HashMapL<> ghostIndex; //address->slot in ghost
+    long ghost[GhostSize]{0}; //ring of addresses evicted from probation, 0 for empty
+    int ghost_top = 0;
+    CachePolicy policy = CachePolicy::LRU;
     Editor<T> f;
-public:
-    Cache() {
-        memset(pre, -1, sizeof(pre));
-        memset(to, -1, sizeof(to));
-    };
-
-    ~Cache() {
-        for (int i = 0; i < size; ++i) if (pos[i]) f.write(pos[i], val[i]);
-        f.close();
+    BufferPool &pool = BufferPool::instance();
+
+    void reserve() { //make sure there is an unused frame slot
+        if (spare_top || size < cap) return;
+        int newCap = cap ? cap << 1 : 16;
+        auto **newVal = new T *[newCap]{nullptr};
+        auto *newPos = new long[newCap]{0};
+        auto *newStamp = new unsigned long long[newCap]{0};
+        auto *newDirty = new bool[newCap]{false};
+        auto *newPre = new int[newCap], *newTo = new int[newCap], *newQueue = new int[newCap], *newSpare = new int[newCap];
+        if (cap) {
+            memcpy(newVal, val, sizeof(T *) * cap);
+            memcpy(newPos, pos, sizeof(long) * cap);
+            memcpy(newStamp, stamp, sizeof(unsigned long long) * cap);
+            memcpy(newDirty, dirty, sizeof(bool) * cap);
+            memcpy(newPre, pre, sizeof(int) * cap);
+            memcpy(newTo, to, sizeof(int) * cap);
+            memcpy(newQueue, queue, sizeof(int) * cap);
+        }
+        freeSlots();
+        val = newVal, pos = newPos, stamp = newStamp, dirty = newDirty;
+        pre = newPre, to = newTo, queue = newQueue, spare = newSpare, cap = newCap;
     }
 
-    inline void clear() {
-        index.clear();
-        memset(pre, -1, sizeof(pre));
-        memset(to, -1, sizeof(to));
-        memset(pos, 0, sizeof(pos));
-        head = tail = -1;
-        size = 0;
+    void freeSlots() { //free slot arrays (not frames)
+        delete[] val;
+        delete[] pos;
+        delete[] stamp;
+        delete[] dirty;
+        delete[] pre;
+        delete[] to;
+        delete[] queue;
+        delete[] spare;
     }
 
-    inline void init(const std::string &name) { f.open(name); } //need init before use
+    void link(int i, int q) { //add frame i to head of queue q
+        queue[i] = q;
+        pre[i] = -1;
+        to[i] = head[q];
+        if (~head[q]) pre[head[q]] = i;
+        else tail[q] = i;
+        head[q] = i;
+        ++count[q];
+    }
 
-    bool has(long addr) { return index.has(addr); }
+    void unlink(int i) { //delete frame i in its queue
+        int q = queue[i];
+        if (~pre[i]) to[pre[i]] = to[i];
+        else head[q] = to[i];
+        if (~to[i]) pre[to[i]] = pre[i];
+        else tail[q] = pre[i];
+        --count[q];
+    }
 
-    T &operator[](long addr) { //address must already have stored value
-        if (index.has(addr)) return get(addr);
-        else return getNew(addr);
+    bool remembered(long addr) { //addr was evicted from probation lately, forget it
+        if (!ghostIndex.has(addr)) return false;
+        int g = ghostIndex[addr];
+        ghostIndex.del(addr, g);
+        ghost[g] = 0;
+        return true;
     }
 
-    T &get(long addr) { //addr already in index
-        int i = index[addr];
-        if (i == head) return val[i];
-        if (~pre[i]) to[pre[i]] = to[i]; //pre[i] != -1
-        if (~to[i]) pre[to[i]] = pre[i];
-        if (i == tail) tail = pre[i]; //delete i in list
-        pre[i] = -1;
-        to[i] = head;
-        pre[head] = i;
-        head = i; //add i to head
-        return val[i];
+    void remember(long addr) { //push addr into A1out, dropping the oldest one
+        if (ghost[ghost_top]) ghostIndex.del(ghost[ghost_top], ghost_top);
+        ghost[ghost_top] = addr;
+        ghostIndex.insert(addr, ghost_top);
+        ghost_top = (ghost_top + 1) % GhostSize;
     }
 
-    T &getNew(long addr) { //addr not in index (but exist)
-        int tmp; //new index for v
-        if (size == N) {
-            f.write(pos[tail], val[tail]);
-            index.del(pos[tail], tail);
-            tmp = tail;
-            tail = pre[tail];
-            to[tail] = -1; //get tmp out of tail
-            pre[head] = tmp;
-            pre[tmp] = -1;
-            to[tmp] = head;
-            head = tmp; //add tmp to head
-        } else {
-            tmp = size++;
-            if (~head) { //not empty
-                pre[head] = tmp;
-                to[tmp] = head;
-            } else tail = tmp;
-            head = tmp;
-        } //now tmp available for v as head
+    int checkout(long addr, bool modified) { //take a frame from the pool for addr and put it at head
+        pool.acquire(sizeof(T)); //may evict frames of this cache as well
+        reserve();
+        int tmp = spare_top ? spare[--spare_top] : size;
+        ++size;
+        val[tmp] = new T;
         pos[tmp] = addr;
-        f.read(addr, val[tmp]);
+        stamp[tmp] = pool.tick();
+        dirty[tmp] = modified;
+        link(tmp, policy == CachePolicy::LRU || remembered(addr) ? Protected : Probation);
         index.insert(addr, tmp);
-        return val[tmp];
+        return tmp;
     }
 
+    int touch(int i) { //move frame i to head of its queue, a hit on probation does not promote it
+        stamp[i] = pool.tick();
+        int q = queue[i];
+        if (i == head[q]) return i;
+        unlink(i);
+        link(i, q);
+        return i;
+    }
 
-    void addNew(long addr, const T &value) { //add value to cache
-        int tmp; //new index for v
-        if (size == N) {
-            f.write(pos[tail], val[tail]);
-            index.del(pos[tail], tail); //release previous tail
-            tmp = tail;
-            tail = pre[tail];
-            to[tail] = -1; //get tmp out of tail
-            pre[head] = tmp;
-            pre[tmp] = -1;
-            to[tmp] = head;
-            head = tmp; //add tmp to head
+    int load(long addr) { //read addr from file into a new clean frame
+        int tmp = checkout(addr, false);
+        f.read(addr, *val[tmp]);
+        return tmp;
+    }
+
+    void drop(int i) { //remove frame i without writing back
+        unlink(i);
+        index.del(pos[i], i);
+        delete val[i];
+        val[i] = nullptr;
+        spare[spare_top++] = i;
+        --size;
+        if (queue[i] == Pinned) pinnedBytes -= sizeof(T);
+        else pool.release(sizeof(T));
+    }
+
+    int next() const { //frame to evict next, -1 if empty
+        if (count[Probation] && (count[Probation] > ((size - count[Pinned]) >> 2) || !count[Protected]))
+            return tail[Probation]; //a quarter of the frames that can be evicted, pinned ones do not count
+        return tail[Protected];
+    }
+
+    void pinFrame(int i, bool on) { //move frame i into or out of the pinned queue
+        if ((queue[i] == Pinned) == on) return;
+        if (on) {
+            if (pinnedBytes + sizeof(T) > pinBudget) return; //fallback: the frame stays in the pool
+            unlink(i);
+            link(i, Pinned);
+            pinnedBytes += sizeof(T);
+            pool.release(sizeof(T));
         } else {
-            tmp = size++;
-            if (~head) { //not empty
-                pre[head] = tmp;
-                to[tmp] = head;
-            } else tail = tmp;
-            head = tmp;
-        } //now tmp available for v as head
-        pos[tmp] = addr;
-        index.insert(addr, tmp);
-        val[tmp] = value;
+            pool.acquire(sizeof(T)); //frame i is still pinned here, so it cannot be evicted
+            unlink(i);
+            pinnedBytes -= sizeof(T);
+            stamp[i] = pool.tick();
+            link(i, Protected);
+        }
+    }
+
+public:
+    Cache() { pool.attach(this); }
+
+    Cache(const Cache &) = delete;
+
+    Cache &operator=(const Cache &) = delete;
+
+    ~Cache() override {
+        pool.detach(this);
+        flush();
+        clear();
+        freeSlots();
+        f.close();
+    }
+
+    inline void clear() { //discard all frames
+        std::lock_guard<my::Latch> guard(pool.latch);
+        for (int q = 0; q < 3; ++q) while (~head[q]) drop(head[q]);
+        ghostIndex.clear();
+        memset(ghost, 0, sizeof(ghost));
+        ghost_top = 0;
+    }
+
+    inline void init(my::Storage &storage, CachePolicy p = CachePolicy::LRU) { //need init before use
+        f.open(storage);
+        policy = p;
+    }
+
+    void setPinBudget(size_t pages) { //unpin the frames beyond the new budget
+        std::lock_guard<my::Latch> guard(pool.latch);
+        pinBudget = pages * BufferPool::PageSize;
+        while (pinnedBytes > pinBudget) pinFrame(tail[Pinned], false);
+    }
+
+    void pin(long addr, bool on) { //(un)pin the resident frame of addr, pinning fails silently beyond the budget
+        std::lock_guard<my::Latch> guard(pool.latch);
+        if ((pinBudget || count[Pinned]) && index.has(addr)) pinFrame(index[addr], on);
+    }
+
+    bool has(long addr) {
+        std::lock_guard<my::Latch> guard(pool.latch);
+        return index.has(addr);
+    }
+
+    void read(long addr, T &value) { //copy of the value at addr, safe next to other threads
+        std::lock_guard<my::Latch> guard(pool.latch);
+        int i = index.has(addr) ? touch(index[addr]) : load(addr); //load() may reallocate val
+        value = *val[i];
+    }
+
+    void readBytes(long addr, void *buf, size_t len) { //raw copy of the first len bytes at addr
+        std::lock_guard<my::Latch> guard(pool.latch);
+        int i = index.has(addr) ? touch(index[addr]) : load(addr);
+        memcpy(buf, (void *) val[i], len);
+    }
+
+    void writeBytes(long addr, const void *buf, size_t len) { //overwrite the first len bytes at addr
+        std::lock_guard<my::Latch> guard(pool.latch);
+        int i = index.has(addr) ? touch(index[addr]) : load(addr);
+        memcpy((void *) val[i], buf, len);
+        dirty[i] = true;
+    }
+
+    const T &peek(long addr) { //read-only access, the frame stays clean (the reference is not safe next to other threads)
+        std::lock_guard<my::Latch> guard(pool.latch);
+        int i = index.has(addr) ? touch(index[addr]) : load(addr); //load() may reallocate val
+        return *val[i];
+    }
+
+    void put(long addr, const T &value) { //write back later instead of writing through
+        std::lock_guard<my::Latch> guard(pool.latch);
+        int i = index.has(addr) ? touch(index[addr]) : checkout(addr, true);
+        *val[i] = value;
+        dirty[i] = true;
+    }
+
+    T &operator[](long addr) { //address must already have stored value, the frame may be modified
+        std::lock_guard<my::Latch> guard(pool.latch);
+        int i = index.has(addr) ? touch(index[addr]) : load(addr);
+        dirty[i] = true;
+        return *val[i];
+    }
+
+    void flush() override { //write back dirty frames in ascending address order
+        std::lock_guard<my::Latch> guard(pool.latch);
+        if (size == 0) return;
+        auto *addrs = new long[size];
+        int n = 0;
+        for (int q = 0; q < 3; ++q) for (int i = head[q]; ~i; i = to[i]) if (dirty[i]) addrs[n++] = pos[i];
+        quicksort(addrs, 0, n - 1);
+        for (int j = 0; j < n; ++j) {
+            int i = index[addrs[j]];
+            f.write(addrs[j], *val[i]);
+            dirty[i] = false;
+        }
+        delete[] addrs;
+    }
+
+    bool victim(unsigned long long &rank) override {
+        int i = next();
+        if (i == -1) return false;
+        rank = queue[i] == Probation ? stamp[i] : stamp[i] | Hot;
+        return true;
+    }
+
+    void evict() override {
+        int i = next();
+        if (queue[i] == Probation) remember(pos[i]);
+        if (dirty[i]) f.write(pos[i], *val[i]);
+        drop(i);
     }
 
 };
@@ -2,48 +2,60 @@
 #define TICKET_SYSTEM_DATA_H
 
 #include <cstring>
-#include <fstream>
 #include "../STLite/exceptions.hpp"
+#include "storage.h"
 #include "cache.h"
 
-using std::fstream;
-
 namespace my {
 
 /*
  * Class: my::File
  * ---------------------
  * This class provides some simple functions for linear data storage.
+ * Deleted values are kept in a free list (linked through their first bytes)
+ * and reused by later add().
  *
  */
 
     template<class value_type>
     class File {
     public:
-        explicit File(const std::string &name);
+        explicit File(const std::string &name, CachePolicy policy = CachePolicy::LRU,
+                      StorageKind kind = defaultStorageKind());
 
-        ~File() {
-            file.seekp(0);
-            file.write(reinterpret_cast<const char *>(&endAddress), sizeof(long));
-            file.close();
-        }
+        ~File() { writeHeader(); }
 
-        inline long add(const value_type &value); //add a new value at the end of the file and return address
+        inline long add(const value_type &value); //add a new value (reusing deleted space) and return address
 
         inline void write(long address, const value_type &value); //must use legal address
 
         inline void read(long address, value_type &value); //must use legal address
 
-        inline void del(); //delete the last value of the file, do nothing if the file is empty
+        inline void del(long address); //release the value at address for reuse, must use legal address
 
         inline void clear();
 
         inline bool empty();
 
+        inline void flush(); //checkpoint: header and all dirty values reach the file
+
+        inline void reload(); //drop cached values and reread the header, e.g. after restoring a snapshot
+
     protected:
-        fstream file;
-        long endAddress = sizeof(long);
+        static_assert(sizeof(value_type) >= sizeof(long), "File: value too small to link deleted space");
+
+        constexpr static long firstAddress = sizeof(long) << 1;
+        //we write endAddress and freeHead at the beginning of file
+
+        Storage file; //declared before cache, which writes back through it when destroyed
+        long endAddress = firstAddress;
+        long freeHead = 0; //last deleted value, which stores the address of the one deleted before it
         Cache<value_type> cache;
+
+        void writeHeader() {
+            file.write(0, &endAddress, sizeof(long));
+            file.write(sizeof(long), &freeHead, sizeof(long));
+        }
     };
 
 //----------------------------------------------------------------------------
@@ -51,57 +63,72 @@ namespace my {
 //----------------------------------------------------------------------------
 
     template<class value_type>
-    File<value_type>::File(const std::string &name) {
-        file.open(name);
-        if (file) {
-            file.seekg(0);
-            file.read(reinterpret_cast<char *>(&endAddress), sizeof(long));
-        } else { //create file
-            file.open(name, std::ios::out);
-            file.write(reinterpret_cast <char *> (&endAddress), sizeof(long));
-            file.close();
-            file.open(name);
-        }
-        cache.init(name);
+    File<value_type>::File(const std::string &name, CachePolicy policy, StorageKind kind) : file(name, kind) {
+        if (file.size()) {
+            file.read(0, &endAddress, sizeof(long));
+            file.read(sizeof(long), &freeHead, sizeof(long));
+        } else writeHeader(); //create file
+        cache.init(file, policy);
     }
 
 
     template<class value_type>
     long File<value_type>::add(const value_type &value) {
-        file.seekp(endAddress);
-        file.write(reinterpret_cast <const char *> (&value), sizeof(value_type));
-        cache.addNew(endAddress, value);
-        endAddress += sizeof(value_type);
-        return endAddress - sizeof(value_type);
+        long address;
+        if (freeHead) {
+            address = freeHead;
+            cache.readBytes(address, &freeHead, sizeof(long));
+        } else {
+            address = endAddress;
+            endAddress += sizeof(value_type);
+        }
+        cache.put(address, value); //written back when evicted or flushed
+        return address;
     }
 
     template<class value_type>
     void File<value_type>::write(long address, const value_type &value) {
-        if (cache.has(address)) cache.get(address) = value;
-        file.seekp(address);
-        file.write(reinterpret_cast <const char *> (&value), sizeof(value_type));
+        cache.put(address, value); //written back when evicted or flushed
     }
 
     template<class value_type>
     void File<value_type>::read(long address, value_type &value) {
-        if (cache.has(address)) value = cache.get(address);
-        else value = cache.getNew(address);
+        cache.read(address, value);
     }
 
     template<class value_type>
-    void File<value_type>::del() {
-        if (endAddress != sizeof(long)) endAddress -= sizeof(value_type);
+    void File<value_type>::del(long address) {
+        cache.writeBytes(address, &freeHead, sizeof(long)); //raw bytes: value_type may not copy them all
+        freeHead = address;
     }
 
     template<class value_type>
     void File<value_type>::clear() {
         cache.clear();
-        endAddress = sizeof(long);
+        endAddress = firstAddress;
+        freeHead = 0;
     }
 
     template<class value_type>
     bool File<value_type>::empty() {
-        return endAddress == sizeof(long);
+        return endAddress == firstAddress;
+    }
+
+    template<class value_type>
+    void File<value_type>::reload() {
+        cache.clear();
+        endAddress = firstAddress;
+        freeHead = 0;
+        if (file.size()) {
+            file.read(0, &endAddress, sizeof(long));
+            file.read(sizeof(long), &freeHead, sizeof(long));
+        }
+    }
+
+    template<class value_type>
+    void File<value_type>::flush() {
+        writeHeader();
+        cache.flush();
     }
 
 }
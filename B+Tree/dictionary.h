@@ -0,0 +1,81 @@
+#ifndef TICKET_SYSTEM_DICTIONARY_H
+#define TICKET_SYSTEM_DICTIONARY_H
+
+#include <string>
+#include "storage.h"
+#include "cache.h"
+#include "BPT.h"
+
+/*
+ * Class: my::Dictionary
+ * ---------------------
+ * A persistent string dictionary handing out dense ids 0, 1, 2, ... in order of first use,
+ * so records and keys can keep a 4-byte id and compare it as an integer.
+ * Typical usage of which looks like this:
+ *
+ *    Dictionary<my::string<30>> dict("file");
+ *
+ *    unsigned id = dict.intern(name); //a new id if name was never seen
+ *
+ *    unsigned id;
+ *    dict.find(name, id); //return false if name was never interned (id stay unchanged)
+ *
+ *    std::cout << dict[id]; //the name of an interned id
+ *
+ * Names are looked up through a BPT in "file_ids", and kept by id in "file_names".
+ * Ids are never taken back, there is no erase.
+ *
+ */
+
+namespace my {
+
+    template<class S>
+    class Dictionary {
+    public:
+        explicit Dictionary(const std::string &name) : ids(name + "_ids"), file(name + "_names") { cache.init(file); }
+
+        unsigned intern(const S &s) {
+            unsigned id;
+            if (ids.find(s, id)) return id;
+            id = (unsigned) ids.size();
+            ids.assign(s, id);
+            cache.put(address(id), s); //written back when evicted or flushed
+            return id;
+        }
+
+        bool find(const S &s, unsigned &id) { return ids.find(s, id); }
+
+        S operator[](unsigned id) {
+            S s;
+            cache.read(address(id), s);
+            return s;
+        }
+
+        size_t size() const { return ids.size(); }
+
+        void clear() {
+            ids.clear();
+            cache.clear();
+        }
+
+        void flush() { //checkpoint: both files are up to date
+            ids.flush();
+            cache.flush();
+        }
+
+        void reload() { //e.g. after restoring a snapshot
+            ids.reload();
+            cache.clear();
+        }
+
+    private:
+        BPT<S, unsigned> ids; //name -> id
+        Storage file; //declared before cache, which writes back through it when destroyed
+        Cache<S> cache; //id -> name
+
+        static inline long address(unsigned id) { return (long) id * (long) sizeof(S); }
+    };
+
+}
+
+#endif //TICKET_SYSTEM_DICTIONARY_H
@@ -0,0 +1,139 @@
+#ifndef TICKET_SYSTEM_HEAP_H
+#define TICKET_SYSTEM_HEAP_H
+
+#include <cstring>
+#include "../STLite/exceptions.hpp"
+#include "storage.h"
+#include "cache.h"
+
+/*
+ * Class: my::Heap
+ * ---------------------
+ * Variable-length records in a file of 4 KiB pages, for values whose size differs
+ * a lot from one to the next. Keep the returned address as the value of a BPT.
+ * Typical usage of which looks like this:
+ *
+ *    Heap heap("file");
+ *
+ *    long address = heap.add(bytes, len); //len up to Heap::MaxRecord
+ *
+ *    const unsigned char *p = heap.peek(address); //the bytes, valid until any cache is used again
+ *    size_t len = heap.length(address);
+ *
+ *    heap.del(address); //the space is reused by later add() of the same size class
+ *
+ * Records never straddle two pages, so reading one touches a single cached page.
+ * Each record is prefixed by its length and rounded up to a multiple of 16 bytes;
+ * freed records are kept in one free list per rounded size, linked through their first bytes.
+ * Page 0 holds the end of the heap and the free list heads.
+ *
+ */
+
+namespace my {
+
+    class Heap {
+    public:
+        constexpr static long PageSize = 4096;
+
+        constexpr static size_t Granule = 16, Classes = PageSize / Granule + 1; //class c holds c * Granule bytes
+
+        constexpr static size_t MaxRecord = PageSize - sizeof(unsigned short);
+
+        explicit Heap(const std::string &name, CachePolicy policy = CachePolicy::LRU,
+                      StorageKind kind = defaultStorageKind()) : file(name, kind) {
+            if (file.size()) readHeader();
+            else writeHeader(); //create file
+            cache.init(file, policy);
+        }
+
+        ~Heap() { writeHeader(); }
+
+        long add(const void *record, size_t len) { //return address
+            if (len > MaxRecord) sjtu::error("Heap: record too large");
+            size_t c = sizeClass(len);
+            long address = freeHead[c];
+            if (address) memcpy(&freeHead[c], at(address), sizeof(long));
+            else address = bump(c * Granule);
+            unsigned char *p = at(address, true);
+            auto n = (unsigned short) len;
+            memcpy(p, &n, sizeof(unsigned short));
+            memcpy(p + sizeof(unsigned short), record, len);
+            return address;
+        }
+
+        inline const unsigned char *peek(long address) { return at(address) + sizeof(unsigned short); }
+
+        inline size_t length(long address) {
+            unsigned short n;
+            memcpy(&n, at(address), sizeof(unsigned short));
+            return n;
+        }
+
+        void del(long address) {
+            size_t c = sizeClass(length(address));
+            memcpy(at(address, true), &freeHead[c], sizeof(long));
+            freeHead[c] = address;
+        }
+
+        void clear() {
+            cache.clear();
+            end = PageSize;
+            memset(freeHead, 0, sizeof(freeHead));
+        }
+
+        void flush() { //checkpoint: header and all dirty pages reach the file
+            writeHeader();
+            cache.flush();
+        }
+
+        void reload() { //drop cached pages and reread the header, e.g. after restoring a snapshot
+            clear();
+            if (file.size()) readHeader();
+        }
+
+    private:
+        struct Page {
+            unsigned char bytes[PageSize];
+        };
+
+        Storage file; //declared before cache, which writes back through it when destroyed
+        long end = PageSize; //page 0 is the header
+        long freeHead[Classes]{0}; //by size class, 0 for empty
+        Cache<Page> cache;
+
+        static inline size_t sizeClass(size_t len) { return (len + sizeof(unsigned short) + Granule - 1) / Granule; }
+
+        unsigned char *at(long address, bool modify = false) { //valid until any cache is used again
+            long page = address / PageSize * PageSize;
+            if (modify) return cache[page].bytes + address % PageSize;
+            return const_cast<unsigned char *>(cache.peek(page).bytes) + address % PageSize;
+        }
+
+        long bump(size_t size) { //new space at the end, within one page
+            long in = end % PageSize;
+            if (in && in + (long) size > PageSize) { //the rest of this page is kept for smaller records
+                size_t c = (PageSize - in) / Granule;
+                memcpy(at(end, true), &freeHead[c], sizeof(long));
+                freeHead[c] = end;
+                end += PageSize - in;
+            }
+            if (end % PageSize == 0) cache.put(end, Page{}); //fresh page, nothing to read
+            long address = end;
+            end += (long) size;
+            return address;
+        }
+
+        void readHeader() {
+            file.read(0, &end, sizeof(long));
+            file.read(sizeof(long), freeHead, sizeof(freeHead));
+        }
+
+        void writeHeader() {
+            file.write(0, &end, sizeof(long));
+            file.write(sizeof(long), freeHead, sizeof(freeHead));
+        }
+    };
+
+}
+
+#endif //TICKET_SYSTEM_HEAP_H
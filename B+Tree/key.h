@@ -0,0 +1,84 @@
+#ifndef TICKET_SYSTEM_KEY_H
+#define TICKET_SYSTEM_KEY_H
+
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Struct: my::key_encoding_traits
+ * ---------------------
+ * A key type may declare a fixed-width encoding of itself whose bytes compare
+ * with memcmp exactly like the key's own operators:
+ *
+ *    struct Visit { //my::string<24> place, int day
+ *        constexpr static size_t EncodedSize = 28;
+ *        void encode(unsigned char *out) const; //EncodedSize bytes
+ *        static Visit decode(const unsigned char *in);
+ *    };
+ *
+ * BPT and multiBPT then store only the encoding in their nodes (my::EncodedKey),
+ * and every comparison in a node search is one memcmp, whatever the key type.
+ * Composite keys lay out their fields from the most significant one, each with its
+ * own encode() (my::string has one) or my::encodeInt.
+ * Other key types are stored unchanged: keys that are already one integer (Index, the
+ * interned handles) compare in one instruction, and strings have an encoding.
+ *
+ */
+
+namespace my {
+
+    inline void encodeInt(int x, unsigned char *out) { //4 bytes, big-endian with the sign bit flipped
+        auto u = (unsigned) x ^ 0x80000000u;
+        for (int i = 3; i >= 0; --i, u >>= 8) out[i] = (unsigned char) u;
+    }
+
+    inline int decodeInt(const unsigned char *in) {
+        unsigned u = 0;
+        for (int i = 0; i < 4; ++i) u = u << 8 | in[i];
+        return (int) (u ^ 0x80000000u);
+    }
+
+    template<class K, class = void>
+    struct key_encoding_traits {
+        constexpr static bool value = false;
+    };
+
+    template<class K>
+    struct key_encoding_traits<K, std::void_t<decltype(K::EncodedSize),
+            decltype(std::declval<const K &>().encode(std::declval<unsigned char *>())),
+            decltype(K::decode(std::declval<const unsigned char *>()))>> {
+        constexpr static bool value = true;
+    };
+
+    template<class K>
+    struct EncodedKey { //a key as its encoding, converts back to K on demand
+        unsigned char code[K::EncodedSize]{};
+
+        EncodedKey() = default; //all zero bytes, only a filler for unused slots
+
+        EncodedKey(const K &key) { key.encode(code); }
+
+        operator K() const { return K::decode(code); }
+
+        inline int compare(const EncodedKey &k) const { return memcmp(code, k.code, K::EncodedSize); }
+
+        inline bool operator<(const EncodedKey &k) const { return compare(k) < 0; }
+
+        inline bool operator>(const EncodedKey &k) const { return compare(k) > 0; }
+
+        inline bool operator<=(const EncodedKey &k) const { return compare(k) <= 0; }
+
+        inline bool operator>=(const EncodedKey &k) const { return compare(k) >= 0; }
+
+        inline bool operator==(const EncodedKey &k) const { return compare(k) == 0; }
+
+        inline bool operator!=(const EncodedKey &k) const { return compare(k) != 0; }
+    };
+
+    template<class K>
+    using stored_key = typename std::conditional<key_encoding_traits<K>::value, EncodedKey<K>, K>::type;
+
+}
+
+#endif //TICKET_SYSTEM_KEY_H
@@ -0,0 +1,129 @@
+#ifndef TICKET_SYSTEM_LATCH_H
+#define TICKET_SYSTEM_LATCH_H
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+/*
+ * Latches for concurrent readers
+ * ---------------------
+ * Compiled with TICKET_CONCURRENT=1, BPT and multiBPT allow any number of threads
+ * in find()/count() while one thread at a time modifies the tree
+ * (optimistic lock coupling):
+ *
+ *    - a writer holds the tree's writer latch for a whole operation, and every node
+ *      it writes bumps the node's version stripe to odd until the operation ends
+ *    - a reader never blocks a writer: it notes the version of every node on its path,
+ *      copies the node, and restarts from the root if a version has moved meanwhile
+ *    - all caches and the buffer pool share one short latch (BufferPool::latch)
+ *
+ * Otherwise (the default) every latch here is empty and compiles away.
+ * Cursors, executeAll() and flush() are not meant to run next to a writer.
+ *
+ */
+
+#ifndef TICKET_CONCURRENT
+#define TICKET_CONCURRENT 0
+#endif
+
+namespace my {
+
+    constexpr bool concurrent = TICKET_CONCURRENT;
+
+#if TICKET_CONCURRENT
+
+    using Latch = std::mutex;
+
+    class VersionTable { //node versions striped by address, address 0 stands for the root pointer
+    public:
+        VersionTable() { for (auto &v: version) v = 0; }
+
+        unsigned long long stable(long addr) const { //wait until no writer holds the stripe
+            unsigned long long v;
+            while ((v = stripe(addr)) & 1) std::this_thread::yield();
+            return v;
+        }
+
+        bool validate(long addr, unsigned long long v) const { return stripe(addr) == v; }
+
+        void lock(long addr) { //writer only, held until unlockAll()
+            int s = slot(addr);
+            if (held[s]) return;
+            held[s] = true;
+            heldList[heldTop++] = s;
+            ++version[s];
+        }
+
+        void lockAll() {
+            for (int s = 0; s < Stripes; ++s)
+                if (!held[s]) {
+                    held[s] = true;
+                    heldList[heldTop++] = s;
+                    ++version[s];
+                }
+        }
+
+        void unlockAll() { //end of a write operation
+            while (heldTop) {
+                int s = heldList[--heldTop];
+                ++version[s];
+                held[s] = false;
+            }
+        }
+
+    private:
+        constexpr static int Stripes = 1021;
+
+        std::atomic<unsigned long long> version[Stripes];
+        bool held[Stripes]{false};
+        int heldList[Stripes]{0}, heldTop = 0;
+
+        static inline int slot(long addr) { return (int) ((unsigned long) addr % Stripes); }
+
+        inline unsigned long long stripe(long addr) const { return version[slot(addr)].load(); }
+    };
+
+#else
+
+    struct Latch {
+        inline void lock() {}
+
+        inline void unlock() {}
+    };
+
+    struct VersionTable {
+        inline unsigned long long stable(long) const { return 0; }
+
+        inline bool validate(long, unsigned long long) const { return true; }
+
+        inline void lock(long) {}
+
+        inline void lockAll() {}
+
+        inline void unlockAll() {}
+    };
+
+#endif
+
+    class WriteGuard { //one write operation on a tree
+    public:
+        WriteGuard(Latch &writer, VersionTable &versions) : writer(writer), versions(versions) { writer.lock(); }
+
+        WriteGuard(const WriteGuard &) = delete;
+
+        WriteGuard &operator=(const WriteGuard &) = delete;
+
+        ~WriteGuard() {
+            versions.unlockAll();
+            writer.unlock();
+        }
+
+    private:
+        Latch &writer;
+        VersionTable &versions;
+    };
+
+}
+
+#endif //TICKET_SYSTEM_LATCH_H
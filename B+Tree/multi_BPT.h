@@ -4,9 +4,16 @@
 #include <iostream>
 #include <cstring>
 #include <cmath>
-#include <fstream>
+#include <type_traits>
+#include <atomic>
 #include "../STLite/vector.hpp"
 #include "../STLite/exceptions.hpp"
+#include "storage.h"
+#include "cache.h"
+#include "latch.h"
+#include "key.h"
+#include "page.h"
+#include "traits.h"
 
 /*
  * Class: my::multiBPT
@@ -15,6 +22,8 @@
  * Typical usage of which looks like this:
  *
  *    multiBPT<key_type,value_type> multimap("file");
+ *    multiBPT<key_type,value_type> scanned("file", CachePolicy::TwoQ); //scans do not evict hot nodes
+ *    multiBPT<key_type,value_type,Tuned> tuned("file"); //storage, cache and keys by my::TreeTraits
  *
  *    multimap.insert(key,value); //do nothing if element already exists
  *
@@ -23,18 +32,62 @@
  *    vector<value_type> output; //receive output in ascending order
  *    multimap.find(key,output);
  *
+ *    for (auto it = multimap.lowerBound(key); it.valid() && it.key() == key; ++it) {...} //it.value()
+ *    for (auto it = --multimap.upperBound(key); it.valid() && it.key() == key; --it) {...} //descending
+ *
+ *    int n = multimap.count(key);
+ *
+ *    bool next(key_type &, value_type &); //false at the end of a (key, value)-ascending stream
+ *    multimap.bulkLoad(next, 0.9); //empty multimap only, leaves are packed 90% full
+ *
  *    if(multimap.empty()) {...}
  *
  *    int size = multimap.size();
  *
+ *    multimap.pinInternal(64); //up to 64 pages of internal nodes never leave memory
+ *
+ * Values are stored in leaves only.
+ * Non-leaf nodes keep (key, separator) pairs, see my::separator_traits.
+ * Key types with an encode() are stored and compared as memcmp-able bytes, see key.h.
+ * Every node is one page of TICKET_NODE_PAGE bytes, the file format is described in page.h.
+ * With TICKET_CONCURRENT=1, find() and count() may run on many threads next to one writer (see latch.h).
+ *
  */
 
 namespace my {
 
-    template<class K, class T>
+    /*
+     * Struct: my::separator_traits
+     * ---------------------
+     * The separator is what multiBPT keeps of a value in non-leaf nodes.
+     * It is the value itself, unless the value type declares a smaller stand-in
+     * that orders values exactly like the value's own comparison operators:
+     *
+     *    struct Order {
+     *        using sep_type = int;
+     *        int sep() const { return time; } //Order::operator< compares time
+     *    };
+     *
+     */
+
+    template<class T, class = void>
+    struct separator_traits {
+        using type = T;
+
+        static const T &get(const T &value) { return value; }
+    };
+
+    template<class T>
+    struct separator_traits<T, std::void_t<typename T::sep_type>> {
+        using type = typename T::sep_type;
+
+        static type get(const T &value) { return value.sep(); }
+    };
+
+    template<class K, class T, class Traits = TreeTraits>
     class multiBPT {
     public:
-        explicit multiBPT(const std::string &name);
+        explicit multiBPT(const std::string &name, CachePolicy policy = Traits::cache); //policy of node cache
 
         ~multiBPT();
 
@@ -42,37 +95,70 @@ namespace my {
 
         bool erase(const K &key, const T &value); //return false if element not found
 
+        template<class Source>
+        void bulkLoad(Source next, double fill = 1.0); //build an empty tree bottom-up from sorted input
+
         void find(const K &key, sjtu::vector<T> &output); //return in ascending order,empty if not found
 
+        size_t count(const K &key); //number of elements with key
+
+        class cursor;
+
+        cursor begin();
+
+        cursor end(); //one past the last element, --end() is the last one
+
+        cursor lowerBound(const K &key); //first element with key >= key
+
+        cursor upperBound(const K &key); //first element with key > key
+
         size_t size() const { return size_; }
 
         bool empty() const { return size_ == 0; }
 
         void clear() {
-            root_pos = 0;
-            endAddress = firstNodeAddress;
-            size_ = 0;
-            root = Node();
+            WriteGuard guard(writer, versions);
+            reset();
+        }
+
+        void pinInternal(size_t pages) { cache.setPinBudget(pages); } //keep internal nodes resident, 0 to disable
+
+        void reload() { //drop everything cached and reread the file, e.g. after restoring a snapshot
+            WriteGuard guard(writer, versions);
+            reset();
+            if (file.size()) {
+                readHeader();
+                if (root_pos) file.read(root_pos, &root, sizeof(Node));
+            }
+        }
+
+        void flush() { //checkpoint: header and all dirty nodes reach the file
+            WriteGuard guard(writer, versions);
+            writeHeader();
+            cache.flush();
         }
 
     private:
-        constexpr static int halfBlockSizeForMulti = 8000 / (sizeof(long) + sizeof(K) + sizeof(T));
+        using sep_type = typename separator_traits<T>::type;
 
-        constexpr static int Degree = halfBlockSizeForMulti << 1 | 1; //odd number required here
-        //we keep one empty space for split
+        using Key = typename Traits::template key<K>; //what nodes keep of a key
 
-        constexpr static int firstNodeAddress = (sizeof(long) << 1) + sizeof(int);
-        //we write root_pos, endAddress and size_ at the beginning of file
+        constexpr static long firstNodeAddress = NodePage; //page 0 holds the FileHeader, see page.h
 
         std::string filename;
-        std::fstream file;
+        Storage file; //declared before cache, which writes back through it when destroyed
 
-        long root_pos = 0;
+        std::atomic<long> root_pos{0}; //read by descend() without the writer latch
         long endAddress = firstNodeAddress;
         int size_ = 0;
+        long freeNode = 0; //head of the list of released nodes, linked through Node::fa
+        unsigned long long lsn = 0; //of the last node written
+
+        Latch writer; //one modifying operation at a time
+        VersionTable versions; //node versions checked by find() and count(), see latch.h
 
         struct Element {
-            K key{};
+            Key key{};
             T value{};
 
             Element() = default;
@@ -106,47 +192,111 @@ namespace my {
             bool operator!=(const Element &e) const { return key != e.key || value != e.value; }
         };
 
-        struct Node {
-            int size = 0;
-            long fa = 0;
+        struct Separator { //what non-leaf nodes keep of an element
+            Key key{};
+            sep_type sep{};
+
+            Separator() = default;
+
+            explicit Separator(const Element &e) : key(e.key), sep(separator_traits<T>::get(e.value)) {}
+
+            bool operator<(const Separator &s) const {
+                if (key == s.key) return sep < s.sep;
+                else return key < s.key;
+            }
+
+            bool operator>(const Separator &s) const {
+                if (key == s.key) return sep > s.sep;
+                else return key > s.key;
+            }
+
+            bool operator>=(const Separator &s) const {
+                if (key == s.key) return sep >= s.sep;
+                else return key > s.key;
+            }
+
+            bool operator==(const Separator &s) const { return key == s.key && sep == s.sep; }
+        };
+
+        constexpr static size_t NodeBody = NodePage - sizeof(PageHeader) - sizeof(long) * 3; //after fa, prev, next
+
+        constexpr static int halfBlockSizeForMulti =
+                ((NodeBody - sizeof(long) * 2) / (sizeof(Separator) + sizeof(long)) - 1) / 2;
+        //D separators and D + 1 pointers of a non-leaf node, one long spent on alignment
+
+        constexpr static int Degree = halfBlockSizeForMulti << 1 | 1; //odd number required here
+        //we keep one empty space for split
+
+        constexpr static int halfLeafSize =
+                ((NodeBody - sizeof(unsigned short)) / (sizeof(Element) + sizeof(unsigned short)) - 1) / 2;
+
+        constexpr static int LeafDegree = halfLeafSize << 1 | 1; //leaves hold whole elements, so fewer of them
 
-            Element e[Degree]{}; //we store value even in non-leaf node
+        static_assert(halfBlockSizeForMulti >= 2 && halfLeafSize >= 2,
+                      "element too large for the node page, raise TICKET_NODE_PAGE");
 
-            long ptr[Degree + 1] = {0}; // when node is leaf, ptr[1] points to next leaf, ptr[0] = 0
+        constexpr static size_t PtrOffset = alignUp(sizeof(Separator) * Degree, alignof(long)); //non-leaf, after s
 
-            Node() = default;
+        constexpr static size_t SlotOffset = alignUp(sizeof(Element) * LeafDegree, alignof(unsigned short));
+        //leaf, after e
 
-            Node(const Node &n) : size(n.size), fa(n.fa) {
-                memcpy(e, n.e, sizeof(Element) * Degree);
-                memcpy(ptr, n.ptr, sizeof(long) * (Degree + 1));
+        static_assert(PtrOffset + sizeof(long) * (Degree + 1) <= NodeBody &&
+                      SlotOffset + sizeof(unsigned short) * LeafDegree <= NodeBody, "node overflows its page");
+
+        struct Node : public PageHeader { //exactly one page
+            long fa = 0;
+            long prev = 0, next = 0; //when node is leaf, the neighbouring leaves
+
+            union {
+                Element e[LeafDegree]; //leaf: a heap in no particular order, see at()
+                Separator s[Degree]; //non-leaf, s[i] is the smallest element under child(i + 1)
+                unsigned char body[NodeBody]; //the arrays below follow e or s
+            };
+
+            Node() {
+                memset((void *) body, 0, NodeBody);
+                for (int i = 0; i < LeafDegree; ++i) slots()[i] = i;
             }
 
+            Node(const Node &n) { memcpy((void *) this, &n, sizeof(Node)); }
+
             Node &operator=(const Node &n) { //deep copy
-                if (this == &n) return *this;
-                size = n.size;
-                fa = n.fa;
-                memcpy(e, n.e, sizeof(Element) * Degree);
-                memcpy(ptr, n.ptr, sizeof(long) * (Degree + 1));
+                if (this != &n) memcpy((void *) this, &n, sizeof(Node));
                 return *this;
             }
 
-            inline bool isLeaf() { return ptr[0] == 0; }
+            inline bool isLeaf() const { return type == LeafPage; }
+
+            inline long *ptr() { return reinterpret_cast<long *>(body + PtrOffset); } //non-leaf: the children
+
+            inline unsigned short *slots() { return reinterpret_cast<unsigned short *>(body + SlotOffset); }
+            //leaf: heap places in element order, the free ones after size
+
+            inline const unsigned short *slots() const {
+                return reinterpret_cast<const unsigned short *>(body + SlotOffset);
+            }
+
+            inline long &child(int i) { return ptr()[i]; }
+
+            inline Element &at(int i) { return e[slots()[i]]; } //leaf: the i-th element in order
+
+            inline const Element &at(int i) const { return e[slots()[i]]; }
 
-            int lowerBound(const K &key) { //return first e[i] >= key, no find then return size
+            int lowerBound(const Key &key) { //return first e[i] >= key, no find then return size
                 int l = 0, r = size - 1, mid;
                 while (l <= r) {
                     mid = (l + r) >> 1;
-                    if (key > e[mid].key) l = mid + 1;
+                    if (key > at(mid).key) l = mid + 1;
                     else r = mid - 1; //e[r+1] >= key
                 }
                 return l;
             }
 
-            int upperBound(const K &key) { //return first e[i] > key, no find then return size
+            int upperBound(const Key &key) { //return first e[i] > key, no find then return size
                 int l = 0, r = size - 1, mid;
                 while (l <= r) {
                     mid = (l + r) >> 1;
-                    if (key >= e[mid].key) l = mid + 1;
+                    if (key >= at(mid).key) l = mid + 1;
                     else r = mid - 1;
                 }
                 return l;
@@ -156,7 +306,7 @@ namespace my {
                 int l = 0, r = size - 1, mid;
                 while (l <= r) {
                     mid = (l + r) >> 1;
-                    if (ele > e[mid]) l = mid + 1;
+                    if (ele > at(mid)) l = mid + 1;
                     else r = mid - 1;
                 }
                 return l;
@@ -166,37 +316,142 @@ namespace my {
                 int l = 0, r = size - 1, mid;
                 while (l <= r) {
                     mid = (l + r) >> 1;
-                    if (ele >= e[mid]) l = mid + 1;
+                    if (ele >= at(mid)) l = mid + 1;
                     else r = mid - 1;
                 }
                 return l;
             }
 
-            bool find(const K &key) {
+            bool find(const Key &key) {
                 int i = lowerBound(key);
                 if (i == size) return false;
-                return e[i].key == key;
+                return at(i).key == key;
             }
 
             bool find(const Element &ele) {
                 int i = lowerBound(ele);
                 if (i == size) return false;
-                return e[i] == ele;
+                return at(i) == ele;
+            }
+
+            //the searches below are over the separators of a non-leaf node
+
+            int sepLowerBound(const Key &key) {
+                int l = 0, r = size - 1, mid;
+                while (l <= r) {
+                    mid = (l + r) >> 1;
+                    if (key > s[mid].key) l = mid + 1;
+                    else r = mid - 1;
+                }
+                return l;
+            }
+
+            int sepUpperBound(const Key &key) {
+                int l = 0, r = size - 1, mid;
+                while (l <= r) {
+                    mid = (l + r) >> 1;
+                    if (key >= s[mid].key) l = mid + 1;
+                    else r = mid - 1;
+                }
+                return l;
+            }
+
+            int sepLowerBound(const Separator &sep) {
+                int l = 0, r = size - 1, mid;
+                while (l <= r) {
+                    mid = (l + r) >> 1;
+                    if (sep > s[mid]) l = mid + 1;
+                    else r = mid - 1;
+                }
+                return l;
+            }
+
+            int sepUpperBound(const Separator &sep) {
+                int l = 0, r = size - 1, mid;
+                while (l <= r) {
+                    mid = (l + r) >> 1;
+                    if (sep >= s[mid]) l = mid + 1;
+                    else r = mid - 1;
+                }
+                return l;
             }
 
         } root;
 
+        Cache<Node> cache;
+
         inline void readNode(long address, Node &node) {
-            file.seekg(address);
-            file.read(reinterpret_cast<char *>(&node), sizeof(Node));
+            cache.read(address, node);
+            if (node.type == InternalPage) cache.pin(address, true);
+        }
+
+        inline void writeNode(long address, Node &node) { //dirty until evicted or flushed
+            versions.lock(address); //odd until the operation ends, readers holding a copy restart
+            node.lsn = ++lsn;
+            cache.put(address, node);
+            cache.pin(address, node.type == InternalPage);
         }
 
-        inline void writeNode(long address, const Node &node) {
-            file.seekp(address);
-            file.write(reinterpret_cast<const char *>(&node), sizeof(Node));
+        inline void setRoot(long address) { //readers check the root pointer under address 0
+            versions.lock(0);
+            root_pos.store(address, std::memory_order_release);
         }
 
-        long findLeafNode(const K &key, Node &node) { //get required node in node
+        void reset() { //clear() with the writer latch held
+            versions.lockAll();
+            root_pos = 0;
+            endAddress = firstNodeAddress;
+            freeNode = 0;
+            size_ = 0;
+            root = Node();
+            cache.clear();
+        }
+
+        static FileHeader format() { return FileHeader(MultiMapTree, sizeof(Key), sizeof(T)); }
+
+        void readHeader() {
+            FileHeader header;
+            file.read(0, &header, sizeof(FileHeader));
+            header.check(filename, format());
+            root_pos = header.root;
+            endAddress = header.end;
+            size_ = header.size;
+            freeNode = header.freeNode;
+            lsn = header.lsn;
+        }
+
+        void writeHeader() {
+            FileHeader header = format();
+            header.root = root_pos;
+            header.end = endAddress;
+            header.size = size_;
+            header.freeNode = freeNode;
+            header.lsn = lsn;
+            file.write(0, &header, sizeof(FileHeader));
+        }
+
+        long allocNode() { //reuse a released node if there is one
+            if (!freeNode) {
+                endAddress += sizeof(Node);
+                return endAddress - sizeof(Node);
+            }
+            long address = freeNode;
+            versions.lock(address); //a reader may still follow a stale pointer to it
+            Node node;
+            cache.read(address, node);
+            freeNode = node.fa;
+            return address;
+        }
+
+        void releaseNode(long address) {
+            Node node;
+            node.type = FreePage;
+            node.fa = freeNode;
+            writeNode(address, node);
+            freeNode = address;
+        }
+
+        long findLeafNode(const Key &key, Node &node) { //get required node in node
             if (size_ == 0) {
                 node = Node();
                 return 0;
@@ -204,7 +459,7 @@ namespace my {
             long addr = root_pos; //always points to the address of node
             node = root;
             while (!node.isLeaf()) {
-                addr = node.ptr[node.lowerBound(key)]; //debug: not upperbound! Different with element version.
+                addr = node.child(node.sepLowerBound(key)); //debug: not upperbound! Different with element version.
                 readNode(addr, node);
             }
             return addr; //if root is leaf, return root_pos
@@ -217,111 +472,265 @@ namespace my {
             }
             long addr = root_pos; //always points to the address of node
             node = root;
+            Separator sep(ele);
             while (!node.isLeaf()) {
-                addr = node.ptr[node.upperBound(ele)];
+                addr = node.child(node.sepUpperBound(sep));
                 readNode(addr, node);
             }
             return addr; //if root is leaf, return root_pos
         }
 
-        void insertInternal(long curAddr, long rightAddr, const Element &ele);
+        long findLastLeafNode(const Key &key, Node &node) { //the leaf holding the first element > key
+            if (size_ == 0) {
+                node = Node();
+                return 0;
+            }
+            long addr = root_pos;
+            node = root;
+            while (!node.isLeaf()) {
+                addr = node.child(node.sepUpperBound(key));
+                readNode(addr, node);
+            }
+            return addr;
+        }
+
+        bool descend(const Key &key, Node &node, long &addr, unsigned long long &version) {
+            //findLeafNode() for readers, false if a writer got in the way
+            unsigned long long top = versions.stable(0);
+            addr = root_pos.load(std::memory_order_acquire);
+            if (!addr) {
+                node = Node();
+                return versions.validate(0, top);
+            }
+            version = versions.stable(addr);
+            if constexpr (concurrent) readNode(addr, node); //root is changed in place by the writer
+            else node = root;
+            if (!versions.validate(addr, version) || !versions.validate(0, top)) return false;
+            while (!node.isLeaf()) {
+                long son = node.child(node.sepLowerBound(key));
+                unsigned long long v = versions.stable(son);
+                if (!versions.validate(addr, version)) return false; //son may be stale
+                readNode(son, node);
+                if (!versions.validate(son, v)) return false;
+                addr = son, version = v;
+            }
+            return true;
+        }
+
+        template<class Visit>
+        bool scan(const Key &key, Visit visit) { //visit values with key in ascending order, false if a writer got in the way
+            Node tmp;
+            long addr;
+            unsigned long long version;
+            if (!descend(key, tmp, addr, version)) return false;
+            if (!addr) return true;
+            for (int i = tmp.lowerBound(key); i < tmp.size; ++i) {
+                if (tmp.at(i).key == key) visit(tmp.at(i).value);
+                else return true;
+            }
+            while (tmp.next) {
+                long next = tmp.next;
+                unsigned long long v = versions.stable(next);
+                if (!versions.validate(addr, version)) return false;
+                readNode(next, tmp);
+                if (!versions.validate(next, v)) return false;
+                addr = next, version = v;
+                for (int i = 0; i < tmp.size; ++i) {
+                    if (tmp.at(i).key == key) visit(tmp.at(i).value);
+                    else return true;
+                }
+            }
+            return true;
+        }
+
+        void insertInternal(long curAddr, long rightAddr, const Separator &sep);
+
+        void linkPrev(long address, long prev_pos) { //make the leaf at address point back to prev_pos
+            if (!address) return;
+            Node node;
+            readNode(address, node);
+            node.prev = prev_pos;
+            writeNode(address, node);
+        }
 
-        static inline void removeVal(int index, Node &node) { //remove e[index] from node (no change for ptr)
+        static inline void removeVal(int index, Node &node) { //remove at(index) from a leaf, only slots move
             if (node.size == 0) return;
-            for (int i = index; i < node.size - 1; ++i)
-                node.e[i] = node.e[i + 1];
-            node.e[--node.size] = Element();
+            unsigned short place = node.slots()[index];
+            memmove(node.slots() + index, node.slots() + index + 1, sizeof(unsigned short) * (node.size - index - 1));
+            node.slots()[--node.size] = place; //free again
         }
 
-        static inline void insertVal(int index, const Element &e, Node &node) { //insert e to node.e[index]
-            for (int i = node.size++; i > index; --i) node.e[i] = node.e[i - 1];
-            node.e[index] = e;
+        static inline void insertVal(int index, const Element &e, Node &node) { //insert e as at(index) of a leaf
+            unsigned short place = node.slots()[node.size]; //the first free place in the heap
+            memmove(node.slots() + index + 1, node.slots() + index, sizeof(unsigned short) * (node.size - index));
+            node.slots()[index] = place;
+            node.e[place] = e;
+            ++node.size;
         }
 
         static inline void mergeLeafNode(Node &left, const Node &right) { //merge right node to left
             //node right remain unchanged, which is going to be discarded
             for (int j = 0; j < right.size; ++j)
-                left.e[left.size + j] = right.e[j];
+                left.at(left.size + j) = right.at(j);
             left.size += right.size;
-            left.ptr[1] = right.ptr[1];
+            left.next = right.next;
         }
 
         void eraseAdjust(long address, Node &node);
 
         void eraseAdjustInternal(long address, Node &node);
 
+        static int fillSize(double fill, int least, int most) { //entries per node for a fill factor
+            int n = (int) (fill * most);
+            return n < least ? least : (n > most ? most : n);
+        }
+
+        static int groupCount(int n, int per, int least) { //split n children evenly, at least least each
+            int m = (n + per - 1) / per;
+            if (m > 1 && n / m < least) m = n / least;
+            return m;
+        }
+
     };
 
 
     //-----------------------------------core implement--------------------------------------------
 
-    template<class K, class T>
-    multiBPT<K, T>::multiBPT(const std::string &name):filename(name) { //open file
-        file.open(name);
-        if (file) {
-            file.seekg(0);
-            file.read(reinterpret_cast<char *>(&root_pos), sizeof(long));
-            file.read(reinterpret_cast<char *>(&endAddress), sizeof(long));
-            file.read(reinterpret_cast<char *>(&size_), sizeof(int));
-            if (root_pos) {
-                file.seekg(root_pos);
-                file.read(reinterpret_cast<char *>(&root), sizeof(Node));
-            }
-        } else { //create new file, root_pos = 0
-            file.open(name, std::ios::out);
-            file.seekp(0);
-            file.write(reinterpret_cast<char *>(&root_pos), sizeof(long));
-            file.write(reinterpret_cast<char *>(&endAddress), sizeof(long));
-            file.write(reinterpret_cast<char *>(&size_), sizeof(int));
-            file.close();
-            file.open(name);
-        }
+    template<class K, class T, class Traits>
+    multiBPT<K, T, Traits>::multiBPT(const std::string &name, CachePolicy policy):filename(name),
+                                                                               file(name, Traits::storage()) { //open file
+        if (file.size()) {
+            readHeader();
+            if (root_pos) file.read(root_pos, &root, sizeof(Node));
+        } else writeHeader(); //create new file, root_pos = 0
+        cache.init(file, policy);
+        if (Traits::pinPages) cache.setPinBudget(Traits::pinPages);
+    }
+
+    template<class K, class T, class Traits>
+    multiBPT<K, T, Traits>::~multiBPT() { writeHeader(); }
+
+    template<class K, class T, class Traits>
+    void multiBPT<K, T, Traits>::find(const K &key, sjtu::vector<T> &output) {
+        const Key probe(key); //prefix computed once for every retry
+        do output.clear();
+        while (!scan(probe, [&output](const T &value) { output.push_back(value); }));
     }
 
-    template<class K, class T>
-    multiBPT<K, T>::~multiBPT() {
-        file.seekp(0);
-        file.write(reinterpret_cast<char *>(&root_pos), sizeof(long));
-        file.write(reinterpret_cast<char *>(&endAddress), sizeof(long));
-        file.write(reinterpret_cast<char *>(&size_), sizeof(int));
-        file.close();
+    template<class K, class T, class Traits>
+    size_t multiBPT<K, T, Traits>::count(const K &key) {
+        const Key probe(key);
+        size_t n;
+        do n = 0;
+        while (!scan(probe, [&n](const T &) { ++n; }));
+        return n;
     }
 
-    template<class K, class T>
-    void multiBPT<K, T>::find(const K &key, sjtu::vector<T> &output) {
-        output.clear();
-        if (size_ == 0) return;
-        Node tmp;
-        findLeafNode(key, tmp);
-        for (int i = tmp.lowerBound(key); i < tmp.size; ++i) {
-            if (tmp.e[i].key == key) output.push_back(tmp.e[i].value);
-            else return;
+    /*
+     * Class: my::multiBPT::cursor
+     * ---------------------
+     * A position in the leaf chain, which walks both ways through the next/prev links.
+     * The cursor keeps a copy of its leaf, so it must not be used after the tree is modified.
+     * Stepping past either end leaves it invalid.
+     */
+    template<class K, class T, class Traits>
+    class multiBPT<K, T, Traits>::cursor {
+    public:
+        bool valid() const { return pos && i >= 0 && i < node.size; }
+
+        K key() const { return node.at(i).key; } //nodes may keep only an encoding of it
+
+        const T &value() const { return node.at(i).value; }
+
+        cursor &operator++() {
+            if (!pos || i >= node.size) return *this;
+            if (++i == node.size) forward();
+            return *this;
         }
-        while (tmp.ptr[1]) {
-            readNode(tmp.ptr[1], tmp);
-            for (int i = 0; i < tmp.size; ++i) {
-                if (tmp.e[i].key == key) output.push_back(tmp.e[i].value);
-                else return;
+
+        cursor &operator--() {
+            if (!pos || i < 0) return *this;
+            if (--i < 0 && node.prev) {
+                pos = node.prev;
+                tree->readNode(pos, node);
+                i = node.size - 1;
             }
+            return *this;
+        }
+
+    private:
+        friend class multiBPT<K, T, Traits>;
+
+        multiBPT *tree;
+        Node node;
+        long pos = 0; //0 for an empty tree
+        int i = 0;
+
+        cursor(multiBPT *t, long p, const Node &n, int index) : tree(t), node(n), pos(p), i(index) {
+            if (pos && i == node.size) forward();
+        }
+
+        void forward() { //i has run off the end of this leaf, move to the next one if any
+            if (!node.next) return;
+            pos = node.next;
+            tree->readNode(pos, node);
+            i = 0;
+        }
+    };
+
+    template<class K, class T, class Traits>
+    typename multiBPT<K, T, Traits>::cursor multiBPT<K, T, Traits>::begin() {
+        Node tmp = root;
+        long addr = root_pos;
+        while (addr && !tmp.isLeaf()) {
+            addr = tmp.child(0);
+            readNode(addr, tmp);
+        }
+        return cursor(this, addr, tmp, 0);
+    }
+
+    template<class K, class T, class Traits>
+    typename multiBPT<K, T, Traits>::cursor multiBPT<K, T, Traits>::end() {
+        Node tmp = root;
+        long addr = root_pos;
+        while (addr && !tmp.isLeaf()) {
+            addr = tmp.child(tmp.size);
+            readNode(addr, tmp);
         }
+        return cursor(this, addr, tmp, tmp.size);
+    }
+
+    template<class K, class T, class Traits>
+    typename multiBPT<K, T, Traits>::cursor multiBPT<K, T, Traits>::lowerBound(const K &key) {
+        const Key probe(key);
+        Node tmp;
+        long addr = findLeafNode(probe, tmp);
+        return cursor(this, addr, tmp, tmp.lowerBound(probe));
+    }
+
+    template<class K, class T, class Traits>
+    typename multiBPT<K, T, Traits>::cursor multiBPT<K, T, Traits>::upperBound(const K &key) {
+        const Key probe(key);
+        Node tmp;
+        long addr = findLastLeafNode(probe, tmp);
+        return cursor(this, addr, tmp, tmp.upperBound(probe));
     }
 
-    template<class K, class T>
-    void multiBPT<K, T>::insert(const K &key, const T &value) {
+    template<class K, class T, class Traits>
+    void multiBPT<K, T, Traits>::insert(const K &key, const T &value) {
+        WriteGuard guard(writer, versions);
         Element ele(key, value);
         if (root_pos == 0) { //empty Tree
             if (size_) {
                 std::cout << "insert error: size_ != 0 while root_pos = 0" << std::endl;
                 throw sjtu::bpt_error();
             } //safety check
-            root.fa = 0;
+            root = Node();
             root.size = 1;
-            root.e[0] = ele;
-            root.ptr[0] = root.ptr[1] = 0;
-            root_pos = firstNodeAddress;
+            root.at(0) = ele;
+            setRoot(allocNode());
             writeNode(root_pos, root);
             size_ = 1;
-            endAddress += sizeof(Node);
             return;
         }
         Node ttmp;
@@ -329,121 +738,205 @@ namespace my {
         Node &tmp = (tmp_pos == root_pos) ? root : ttmp; //be careful about root!
 
         int i = tmp.lowerBound(ele);
-        if (tmp.e[i] == ele && i != tmp.size) return;
+        if (tmp.at(i) == ele && i != tmp.size) return;
         else size_++; //(will) insert successfully
 
-        for (int j = tmp.size; j > i; --j) tmp.e[j] = tmp.e[j - 1]; //size not updated
-        tmp.e[i] = ele;
-        tmp.size++;
+        insertVal(i, ele, tmp);
 
-        if (tmp.size < Degree) {
+        if (tmp.size < LeafDegree) {
             writeNode(tmp_pos, tmp);
         } else { //we have to split node now
             Node newLeaf; //at right
-            newLeaf.size = tmp.size - halfBlockSizeForMulti;
-            tmp.size = halfBlockSizeForMulti;
-            for (int j = 0; j < newLeaf.size; ++j) {
-                newLeaf.e[j] = tmp.e[halfBlockSizeForMulti + j];
-                tmp.e[halfBlockSizeForMulti + j] = Element();
-            }
+            newLeaf.size = tmp.size - halfLeafSize;
+            tmp.size = halfLeafSize;
+            for (int j = 0; j < newLeaf.size; ++j) newLeaf.at(j) = tmp.at(halfLeafSize + j); //their places in tmp are free now
             newLeaf.fa = tmp.fa;
-            newLeaf.ptr[1] = tmp.ptr[1];
-            writeNode(endAddress, newLeaf);
-            tmp.ptr[1] = endAddress;
+            newLeaf.next = tmp.next;
+            newLeaf.prev = tmp_pos;
+            long newPos = allocNode();
+            writeNode(newPos, newLeaf);
+            linkPrev(newLeaf.next, newPos);
+            tmp.next = newPos;
             writeNode(tmp_pos, tmp);
-            endAddress += sizeof(Node);
-            insertInternal(tmp.fa, tmp.ptr[1], newLeaf.e[0]);
+            insertInternal(tmp.fa, newPos, Separator(newLeaf.at(0)));
         }
     }
 
-    template<class K, class T>
-    void multiBPT<K, T>::insertInternal(long curAddr, long rightAddr, const multiBPT::Element &ele) {
+    template<class K, class T, class Traits>
+    void multiBPT<K, T, Traits>::insertInternal(long curAddr, long rightAddr, const multiBPT::Separator &sep) {
         if (curAddr == 0) { //new root
             Node newNode;
+            newNode.type = InternalPage;
             newNode.size = 1;
-            newNode.e[0] = ele;
-            newNode.ptr[0] = root_pos;
-            newNode.ptr[1] = rightAddr;
-            root.fa = endAddress; //still old root
+            newNode.s[0] = sep;
+            newNode.child(0) = root_pos;
+            newNode.child(1) = rightAddr;
+            newNode.level = root.level + 1;
+            long newPos = allocNode();
+            root.fa = newPos; //still old root
             writeNode(root_pos, root);
             Node rightNode;
             readNode(rightAddr, rightNode);
-            rightNode.fa = endAddress;
+            rightNode.fa = newPos;
             writeNode(rightAddr, rightNode);
             //
-            root_pos = endAddress;
-            root = newNode;
+            setRoot(newPos);
             writeNode(root_pos, newNode);
-            endAddress += sizeof(Node);
+            root = newNode;
             return;
         }
         Node tmp;
         Node &curNode = (curAddr == root_pos) ? root : tmp;
         if (curAddr != root_pos) readNode(curAddr, curNode);
         //
-        int i = curNode.lowerBound(ele);
-        if (curNode.e[i] == ele && i != curNode.size) {
+        int i = curNode.sepLowerBound(sep);
+        if (curNode.s[i] == sep && i != curNode.size) {
             std::cout << "insert internal error: element to insert already exists" << std::endl;
             throw sjtu::bpt_error();
         } //safety check
 
         for (int j = curNode.size; j > i; --j) {
-            curNode.e[j] = curNode.e[j - 1];
-            curNode.ptr[j + 1] = curNode.ptr[j];
+            curNode.s[j] = curNode.s[j - 1];
+            curNode.child(j + 1) = curNode.child(j);
         }
-        curNode.e[i] = ele;
-        curNode.ptr[i + 1] = rightAddr;
+        curNode.s[i] = sep;
+        curNode.child(i + 1) = rightAddr;
         curNode.size++;
 
         if (curNode.size < Degree)
             writeNode(curAddr, curNode);
         else { //split interval node
             Node newNode;
-            Element newEle = curNode.e[halfBlockSizeForMulti];
+            newNode.type = InternalPage;
+            newNode.level = curNode.level;
+            Separator newSep = curNode.s[halfBlockSizeForMulti];
             newNode.size = curNode.size - halfBlockSizeForMulti - 1;
             curNode.size = halfBlockSizeForMulti;
             newNode.fa = curNode.fa;
             for (int j = 0; j < newNode.size; ++j) {
-                newNode.e[j] = curNode.e[halfBlockSizeForMulti + 1 + j];
-                newNode.ptr[j] = curNode.ptr[halfBlockSizeForMulti + 1 + j];
-                curNode.e[halfBlockSizeForMulti + 1 + j] = Element();
-                curNode.ptr[halfBlockSizeForMulti + 1 + j] = 0;
+                newNode.s[j] = curNode.s[halfBlockSizeForMulti + 1 + j];
+                newNode.child(j) = curNode.child(halfBlockSizeForMulti + 1 + j);
+                curNode.s[halfBlockSizeForMulti + 1 + j] = Separator();
+                curNode.child(halfBlockSizeForMulti + 1 + j) = 0;
             }
-            newNode.ptr[newNode.size] = curNode.ptr[Degree];
-            curNode.ptr[Degree] = 0;
-            curNode.e[halfBlockSizeForMulti] = Element();
+            newNode.child(newNode.size) = curNode.child(Degree);
+            curNode.child(Degree) = 0;
+            curNode.s[halfBlockSizeForMulti] = Separator();
 
+            long newPos = allocNode();
             Node son; //debug: don't forget to change son's father!
             for (int j = 0; j <= newNode.size; ++j) {
-                readNode(newNode.ptr[j], son);
-                son.fa = endAddress;
-                writeNode(newNode.ptr[j], son);
+                readNode(newNode.child(j), son);
+                son.fa = newPos;
+                writeNode(newNode.child(j), son);
             }
 
-            writeNode(endAddress, newNode);
-            endAddress += sizeof(Node);
+            writeNode(newPos, newNode);
             writeNode(curAddr, curNode);
-            insertInternal(curNode.fa, endAddress - sizeof(Node), newEle);
+            insertInternal(curNode.fa, newPos, newSep);
+        }
+    }
+
+    template<class K, class T, class Traits>
+    template<class Source>
+    void multiBPT<K, T, Traits>::bulkLoad(Source next, double fill) {
+        WriteGuard guard(writer, versions);
+        if (size_) sjtu::error("invalid use of multiBPT bulkLoad when not empty");
+        reset();
+        int leafSize = fillSize(fill, halfLeafSize, LeafDegree - 1);
+        sjtu::vector<Separator> seps; //the smallest element under every node of the level built last
+        sjtu::vector<long> addrs;
+        Node prev, cur; //the last two leaves stay in memory, so that the last one can be evened out
+        long prev_pos = 0, cur_pos = 0;
+        K key;
+        T value;
+        while (next(key, value)) {
+            Element ele(key, value); //nodes may keep only an encoding of the key
+            if (size_ && !(ele > cur.at(cur.size - 1))) {
+                if (ele == cur.at(cur.size - 1)) continue; //same as insert: already exists
+                reset();
+                sjtu::error("multiBPT bulkLoad: elements not in ascending order");
+            }
+            if (!cur_pos) cur_pos = allocNode();
+            else if (cur.size == leafSize) { //start a new leaf
+                long newPos = allocNode();
+                cur.next = newPos;
+                if (prev_pos) {
+                    writeNode(prev_pos, prev);
+                    seps.push_back(Separator(prev.at(0)));
+                    addrs.push_back(prev_pos);
+                }
+                prev = cur, prev_pos = cur_pos;
+                cur = Node(), cur_pos = newPos;
+                cur.prev = prev_pos;
+            }
+            cur.at(cur.size++) = ele;
+            ++size_;
+        }
+        if (size_ == 0) return;
+        if (prev_pos && cur.size < halfLeafSize) { //the last leaf is too small
+            if (prev.size + cur.size < LeafDegree) {
+                mergeLeafNode(prev, cur);
+                releaseNode(cur_pos);
+                cur_pos = 0;
+            } else {
+                while (cur.size < halfLeafSize) insertVal(0, prev.at(--prev.size), cur);
+            }
+        }
+        if (prev_pos) {
+            writeNode(prev_pos, prev);
+            seps.push_back(Separator(prev.at(0)));
+            addrs.push_back(prev_pos);
         }
+        if (cur_pos) {
+            writeNode(cur_pos, cur);
+            seps.push_back(Separator(cur.at(0)));
+            addrs.push_back(cur_pos);
+        }
+        int fanout = fillSize(fill, halfBlockSizeForMulti, Degree - 1) + 1;
+        while (addrs.size() > 1) { //build the level above
+            sjtu::vector<Separator> upSeps;
+            sjtu::vector<long> upAddrs;
+            int n = (int) addrs.size(), m = groupCount(n, fanout, halfBlockSizeForMulti + 1);
+            for (int g = 0, j = 0; g < m; ++g) {
+                int cnt = n / m + (g < n % m);
+                Node node, son;
+                node.type = InternalPage;
+                node.size = cnt - 1;
+                long pos = allocNode();
+                upSeps.push_back(seps[j]);
+                upAddrs.push_back(pos);
+                for (int c = 0; c < cnt; ++c, ++j) {
+                    if (c) node.s[c - 1] = seps[j];
+                    node.child(c) = addrs[j];
+                    readNode(addrs[j], son);
+                    son.fa = pos;
+                    node.level = son.level + 1;
+                    writeNode(addrs[j], son);
+                }
+                writeNode(pos, node);
+            }
+            seps = upSeps;
+            addrs = upAddrs;
+        }
+        setRoot(addrs[0]);
+        readNode(root_pos, root);
     }
 
-    template<class K, class T>
-    bool multiBPT<K, T>::erase(const K &key, const T &value) {
+    template<class K, class T, class Traits>
+    bool multiBPT<K, T, Traits>::erase(const K &key, const T &value) {
+        WriteGuard guard(writer, versions);
         if (size_ == 0) return false;
         Element ele(key, value);
         Node tmp;
         long tmp_pos = findLeafNode(ele, tmp); //tmp is a leaf node
         int i = tmp.lowerBound(ele);
-        if (tmp.e[i] != ele || i == tmp.size) return false; //element no found
-        else { //tmp.e[i] = ele
+        if (tmp.at(i) != ele || i == tmp.size) return false; //element no found
+        else { //tmp.at(i) = ele
             size_--;
             if (tmp_pos == root_pos) { //root as leaf, only root node
-                if (size_ == 0) { //clear tree
-                    writeNode(root_pos, Node());
-                    root = Node();
-                    root_pos = 0;
-                    endAddress = firstNodeAddress;
-                } else {
+                if (size_ == 0) reset(); //clear tree
+                else {
                     removeVal(i, root);
                     writeNode(root_pos, root);
                 }
@@ -451,7 +944,7 @@ namespace my {
             }
             //now tmp != root
             removeVal(i, tmp);
-            if (tmp.size >= halfBlockSizeForMulti) {
+            if (tmp.size >= halfLeafSize) {
                 writeNode(tmp_pos, tmp);
                 return true;
             }
@@ -460,24 +953,24 @@ namespace my {
         }
     }
 
-    template<class K, class T>
-    void multiBPT<K, T>::eraseAdjust(long address, multiBPT::Node &node) { //node is a leaf and not root
+    template<class K, class T, class Traits>
+    void multiBPT<K, T, Traits>::eraseAdjust(long address, multiBPT::Node &node) { //node is a leaf and not root
         Node tmp;
         Node &faNode = (node.fa == root_pos) ? root : tmp;
         if (node.fa != root_pos) readNode(node.fa, faNode);
         //faNode maybe root!
 
-        int i = faNode.upperBound(node.e[0]) - 1; //maybe -1
+        int i = faNode.sepUpperBound(Separator(node.at(0))) - 1; //maybe -1
         long right_pos = 0, left_pos = 0;
-        if (i != faNode.size - 1) right_pos = faNode.ptr[i + 2];
-        if (i >= 0) left_pos = faNode.ptr[i];
+        if (i != faNode.size - 1) right_pos = faNode.child(i + 2);
+        if (i >= 0) left_pos = faNode.child(i);
         Node rightNode;
         if (right_pos) { //check if borrow from right available
             readNode(right_pos, rightNode);
-            if (rightNode.size > halfBlockSizeForMulti) { //borrow successfully
-                node.e[node.size++] = rightNode.e[0];
+            if (rightNode.size > halfLeafSize) { //borrow successfully
+                node.at(node.size++) = rightNode.at(0);
                 removeVal(0, rightNode);
-                faNode.e[i + 1] = rightNode.e[0];
+                faNode.s[i + 1] = Separator(rightNode.at(0));
                 writeNode(node.fa, faNode);
                 writeNode(address, node);
                 writeNode(right_pos, rightNode);
@@ -487,10 +980,9 @@ namespace my {
         Node leftNode;
         if (left_pos) { //check if borrow from left available
             readNode(left_pos, leftNode);
-            if (leftNode.size > halfBlockSizeForMulti) { //borrow successfully
-                insertVal(0, leftNode.e[--leftNode.size], node);
-                leftNode.e[leftNode.size] = Element();
-                faNode.e[i] = node.e[0];
+            if (leftNode.size > halfLeafSize) { //borrow successfully
+                insertVal(0, leftNode.at(--leftNode.size), node);
+                faNode.s[i] = Separator(node.at(0));
                 writeNode(node.fa, faNode);
                 writeNode(address, node);
                 writeNode(left_pos, leftNode);
@@ -502,27 +994,29 @@ namespace my {
             //merge rightNode to node
             mergeLeafNode(node, rightNode);
             for (int j = i + 1; j < faNode.size - 1; ++j) {
-                faNode.e[j] = faNode.e[j + 1];
-                faNode.ptr[j + 1] = faNode.ptr[j + 2];
+                faNode.s[j] = faNode.s[j + 1];
+                faNode.child(j + 1) = faNode.child(j + 2);
             }
             --faNode.size;
-            faNode.e[faNode.size] = Element();
-            faNode.ptr[faNode.size + 1] = 0;
+            faNode.s[faNode.size] = Separator();
+            faNode.child(faNode.size + 1) = 0;
             writeNode(node.fa, faNode);
             writeNode(address, node);
-            //writeNode(right_pos, Node());
+            releaseNode(right_pos);
+            linkPrev(node.next, address);
         } else if (left_pos) {
             mergeLeafNode(leftNode, node);
             for (int j = i; j < faNode.size - 1; ++j) {
-                faNode.e[j] = faNode.e[j + 1];
-                faNode.ptr[j + 1] = faNode.ptr[j + 2];
+                faNode.s[j] = faNode.s[j + 1];
+                faNode.child(j + 1) = faNode.child(j + 2);
             }
             --faNode.size;
-            faNode.e[faNode.size] = Element();
-            faNode.ptr[faNode.size + 1] = 0;
+            faNode.s[faNode.size] = Separator();
+            faNode.child(faNode.size + 1) = 0;
             writeNode(node.fa, faNode);
             writeNode(left_pos, leftNode);
-            //writeNode(address, Node());
+            releaseNode(address);
+            linkPrev(leftNode.next, left_pos);
         } else {
             std::cout << "erase adjust error: no siblings" << std::endl;
             throw sjtu::bpt_error();
@@ -530,19 +1024,19 @@ namespace my {
         eraseAdjustInternal(node.fa, faNode); //faNode size -1
     }
 
-    template<class K, class T>
-    void multiBPT<K, T>::eraseAdjustInternal(long address, multiBPT::Node &node) { //node maybe &root
+    template<class K, class T, class Traits>
+    void multiBPT<K, T, Traits>::eraseAdjustInternal(long address, multiBPT::Node &node) { //node maybe &root
         if (node.fa == 0) { //root node
             if (root_pos != address) {
                 std::cout << "erase adjust internal error: root chaos" << std::endl;
                 throw sjtu::bpt_error();
             } //safety check
             if (node.size == 0) { //erase empty root
-                root_pos = node.ptr[0];
+                setRoot(node.child(0));
                 readNode(root_pos, root);
                 root.fa = 0;
                 writeNode(root_pos, root);
-                //writeNode(address, Node());
+                releaseNode(address);
             } else if (&node != &root) root = node;
             return;
         }
@@ -552,30 +1046,30 @@ namespace my {
         Node &faNode = (node.fa == root_pos) ? root : tmp;
         if (node.fa != root_pos) readNode(node.fa, faNode);
 
-        int i = faNode.upperBound(node.e[0]) - 1; //maybe -1
+        int i = faNode.sepUpperBound(node.s[0]) - 1; //maybe -1
         long right_pos = 0, left_pos = 0;
-        if (i != faNode.size - 1) right_pos = faNode.ptr[i + 2];
-        if (i >= 0) left_pos = faNode.ptr[i];
+        if (i != faNode.size - 1) right_pos = faNode.child(i + 2);
+        if (i >= 0) left_pos = faNode.child(i);
         Node rightNode;
         if (right_pos) { //check if borrow from right available
             readNode(right_pos, rightNode);
             if (rightNode.size > halfBlockSizeForMulti) { //borrow successfully
                 Node son;
-                readNode(rightNode.ptr[0], son);
-                node.e[node.size++] = faNode.e[i + 1]; //not rightNode.e[0]
-                node.ptr[node.size] = rightNode.ptr[0];
+                readNode(rightNode.child(0), son);
+                node.s[node.size++] = faNode.s[i + 1]; //not rightNode.s[0]
+                node.child(node.size) = rightNode.child(0);
                 son.fa = address;
-                faNode.e[i + 1] = rightNode.e[0];
+                faNode.s[i + 1] = rightNode.s[0];
                 for (int j = 1; j <= rightNode.size; ++j) {
-                    rightNode.e[j - 1] = rightNode.e[j];
-                    rightNode.ptr[j - 1] = rightNode.ptr[j];
+                    rightNode.s[j - 1] = rightNode.s[j];
+                    rightNode.child(j - 1) = rightNode.child(j);
                 }
-                rightNode.ptr[rightNode.size--] = 0;
+                rightNode.child(rightNode.size--) = 0;
 
                 writeNode(node.fa, faNode);
                 writeNode(address, node);
                 writeNode(right_pos, rightNode);
-                writeNode(node.ptr[node.size], son);
+                writeNode(node.child(node.size), son);
                 return;
             }
         }
@@ -584,82 +1078,82 @@ namespace my {
             readNode(left_pos, leftNode);
             if (leftNode.size > halfBlockSizeForMulti) { //borrow successfully
                 Node son;
-                readNode(leftNode.ptr[leftNode.size], son);
-                node.ptr[node.size + 1] = node.ptr[node.size];
+                readNode(leftNode.child(leftNode.size), son);
+                node.child(node.size + 1) = node.child(node.size);
                 for (int j = node.size; j > 0; --j) {
-                    node.e[j] = node.e[j - 1];
-                    node.ptr[j] = node.ptr[j - 1];
+                    node.s[j] = node.s[j - 1];
+                    node.child(j) = node.child(j - 1);
                 }
-                node.e[0] = faNode.e[i];
-                node.ptr[0] = leftNode.ptr[leftNode.size];
+                node.s[0] = faNode.s[i];
+                node.child(0) = leftNode.child(leftNode.size);
                 node.size++;
                 son.fa = address;
-                faNode.e[i] = leftNode.e[leftNode.size - 1];
+                faNode.s[i] = leftNode.s[leftNode.size - 1];
                 leftNode.size--;
-                leftNode.e[leftNode.size] = Element();
-                leftNode.ptr[leftNode.size + 1] = 0;
+                leftNode.s[leftNode.size] = Separator();
+                leftNode.child(leftNode.size + 1) = 0;
 
                 writeNode(node.fa, faNode);
                 writeNode(address, node);
                 writeNode(left_pos, leftNode);
-                writeNode(node.ptr[0], son);
+                writeNode(node.child(0), son);
                 return;
             }
         }
         //cannot borrow, we have to merge now
         if (right_pos) {
             //merge rightNode to node
-            node.e[node.size] = faNode.e[i + 1];
-            node.ptr[node.size + 1] = rightNode.ptr[0];
+            node.s[node.size] = faNode.s[i + 1];
+            node.child(node.size + 1) = rightNode.child(0);
             Node son;
-            readNode(rightNode.ptr[0], son);
+            readNode(rightNode.child(0), son);
             son.fa = address;
-            writeNode(rightNode.ptr[0], son);
+            writeNode(rightNode.child(0), son);
             for (int j = 0; j < rightNode.size; ++j) {
-                node.e[node.size + 1 + j] = rightNode.e[j];
-                node.ptr[node.size + 2 + j] = rightNode.ptr[j + 1];
-                readNode(rightNode.ptr[j + 1], son);
+                node.s[node.size + 1 + j] = rightNode.s[j];
+                node.child(node.size + 2 + j) = rightNode.child(j + 1);
+                readNode(rightNode.child(j + 1), son);
                 son.fa = address;
-                writeNode(rightNode.ptr[j + 1], son);
+                writeNode(rightNode.child(j + 1), son);
             }
             node.size += rightNode.size + 1;
 
             for (int j = i + 1; j < faNode.size - 1; ++j) {
-                faNode.e[j] = faNode.e[j + 1];
-                faNode.ptr[j + 1] = faNode.ptr[j + 2];
+                faNode.s[j] = faNode.s[j + 1];
+                faNode.child(j + 1) = faNode.child(j + 2);
             }
             --faNode.size;
-            faNode.e[faNode.size] = Element();
-            faNode.ptr[faNode.size + 1] = 0;
+            faNode.s[faNode.size] = Separator();
+            faNode.child(faNode.size + 1) = 0;
             writeNode(node.fa, faNode);
             writeNode(address, node);
-            //writeNode(right_pos, Node());
+            releaseNode(right_pos);
         } else if (left_pos) {
-            leftNode.e[leftNode.size] = faNode.e[i];
-            leftNode.ptr[leftNode.size + 1] = node.ptr[0];
+            leftNode.s[leftNode.size] = faNode.s[i];
+            leftNode.child(leftNode.size + 1) = node.child(0);
             Node son;
-            readNode(node.ptr[0], son);
+            readNode(node.child(0), son);
             son.fa = left_pos;
-            writeNode(node.ptr[0], son);
+            writeNode(node.child(0), son);
             for (int j = 0; j < node.size; ++j) {
-                leftNode.e[leftNode.size + 1 + j] = node.e[j];
-                leftNode.ptr[leftNode.size + 2 + j] = node.ptr[j + 1];
-                readNode(node.ptr[j + 1], son);
+                leftNode.s[leftNode.size + 1 + j] = node.s[j];
+                leftNode.child(leftNode.size + 2 + j) = node.child(j + 1);
+                readNode(node.child(j + 1), son);
                 son.fa = left_pos;
-                writeNode(node.ptr[j + 1], son);
+                writeNode(node.child(j + 1), son);
             }
             leftNode.size += node.size + 1;
 
             for (int j = i; j < faNode.size - 1; ++j) {
-                faNode.e[j] = faNode.e[j + 1];
-                faNode.ptr[j + 1] = faNode.ptr[j + 2];
+                faNode.s[j] = faNode.s[j + 1];
+                faNode.child(j + 1) = faNode.child(j + 2);
             }
             --faNode.size;
-            faNode.e[faNode.size] = Element();
-            faNode.ptr[faNode.size + 1] = 0;
+            faNode.s[faNode.size] = Separator();
+            faNode.child(faNode.size + 1) = 0;
             writeNode(node.fa, faNode);
             writeNode(left_pos, leftNode);
-            //writeNode(address, Node());
+            releaseNode(address);
         } else {
             std::cout << "erase adjust internal error: no siblings" << std::endl;
             throw sjtu::bpt_error();
@@ -0,0 +1,91 @@
+#ifndef TICKET_SYSTEM_PAGE_H
+#define TICKET_SYSTEM_PAGE_H
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include "../STLite/exceptions.hpp"
+
+/*
+ * On-disk node format
+ * ---------------------
+ * A BPT or multiBPT file is a sequence of pages of TICKET_NODE_PAGE bytes (4096, 8192 or 16384):
+ *
+ *    page 0       my::FileHeader: magic, format version, page size, tree kind, key and value sizes,
+ *                 then root, end of file, element count, head of the free list and the last LSN
+ *    page 1, ...  one node each, opened by a my::PageHeader: type, level, count and LSN
+ *
+ * Node degrees are derived from the page size, so every node is exactly one page
+ * and never straddles two pages of the storage below.
+ * The LSN of a page is the value of a per-file counter bumped by every node write,
+ * so the newest of two images of a page can always be told apart.
+ * Opening a file written in another format, page size or key/value layout is an error.
+ *
+ */
+
+#ifndef TICKET_NODE_PAGE
+#define TICKET_NODE_PAGE 4096
+#endif
+
+namespace my {
+
+    constexpr long NodePage = TICKET_NODE_PAGE;
+
+    static_assert(NodePage == 4096 || NodePage == 8192 || NodePage == 16384, "TICKET_NODE_PAGE must be 4, 8 or 16 KiB");
+
+    constexpr unsigned NodeFormatVersion = 1;
+
+    constexpr size_t alignUp(size_t x, size_t a) { return (x + a - 1) / a * a; }
+
+    enum PageType : unsigned char {
+        FreePage = 0, LeafPage = 1, InternalPage = 2
+    };
+
+    struct PageHeader {
+        unsigned char type = LeafPage; //new created as leaf
+        unsigned char reserved = 0;
+        unsigned short level = 0; //0 for leaves, children of level l are at level l - 1
+        int size = 0; //keys in the node
+        unsigned long long lsn = 0; //file LSN of the last write of the page
+    };
+
+    enum TreeKind : unsigned {
+        MapTree = 1, MultiMapTree = 2
+    };
+
+    struct FileHeader {
+        char magic[8] = {'T', 'K', 'T', 'T', 'R', 'E', 'E', '\0'};
+        unsigned version = NodeFormatVersion;
+        unsigned pageSize = NodePage;
+        unsigned kind = 0;
+        unsigned keySize = 0, valueSize = 0; //sizeof the stored key and value types
+        unsigned reserved = 0; //fills what would be padding, so an unchanged header is rewritten byte for byte
+        long root = 0;
+        long end = NodePage; //first node after page 0
+        long freeNode = 0;
+        int size = 0;
+        int reserved2 = 0;
+        unsigned long long lsn = 0;
+
+        FileHeader() = default;
+
+        FileHeader(TreeKind kind, size_t keySize, size_t valueSize) :
+                kind(kind), keySize((unsigned) keySize), valueSize((unsigned) valueSize) {}
+
+        void check(const std::string &file, const FileHeader &expected) const { //throw if not in expected's format
+            if (memcmp(magic, expected.magic, sizeof(magic)) != 0 || version != expected.version)
+                sjtu::error(file + ": not a tree file of node format " + std::to_string(expected.version));
+            if (pageSize != expected.pageSize)
+                sjtu::error(file + ": written with " + std::to_string(pageSize) + "-byte node pages");
+            if (kind != expected.kind || keySize != expected.keySize || valueSize != expected.valueSize)
+                sjtu::error(file + ": written for another key or value type");
+        }
+    };
+
+    static_assert(sizeof(FileHeader) <= NodePage, "file header must fit in page 0");
+
+    static_assert(std::has_unique_object_representations_v<FileHeader>, "no padding in the file header");
+
+}
+
+#endif //TICKET_SYSTEM_PAGE_H
@@ -0,0 +1,273 @@
+#ifndef TICKET_SYSTEM_SNAPSHOT_H
+#define TICKET_SYSTEM_SNAPSHOT_H
+
+#include <string>
+#include <sys/stat.h>
+#include "../STLite/map.hpp"
+#include "../STLite/vector.hpp"
+#include "storage.h"
+
+/*
+ * Class: my::Snapshots
+ * ---------------------
+ * Copy-on-write snapshots of every open Storage, taken at the page level.
+ * Creating a snapshot only records the size of each file, all pages stay shared
+ * with the live files. The first write to a shared page copies the old page into
+ * "snapshot_pages" (one copy for all snapshots sharing it), so a snapshot costs
+ * only the pages that have diverged since it was taken.
+ * Typical usage of which looks like this:
+ *
+ *    Snapshots &snapshots = Snapshots::instance();
+ *
+ *    //write back caches and headers first: a snapshot sees the files only
+ *    snapshots.create("id"); //return false if id exists
+ *
+ *    snapshots.restore("id"); //return false if id not found, reload every tree afterwards
+ *
+ *    snapshots.remove("id"); //return false if id not found, its pages are reused
+ *
+ * Snapshot tables are kept in "snapshot_meta", rewritten by every call above and at exit.
+ *
+ */
+
+namespace my {
+
+    class Snapshots : public StorageHook {
+    public:
+        constexpr static long PageSize = 4096;
+
+        static Snapshots &instance() {
+            static Snapshots snapshots;
+            return snapshots;
+        }
+
+        Snapshots(const Snapshots &) = delete;
+
+        Snapshots &operator=(const Snapshots &) = delete;
+
+        ~Snapshots() override {
+            if (storageHook() == this) storageHook() = nullptr;
+            if (changed) save();
+            delete store;
+        }
+
+        bool create(const std::string &id) {
+            if (snapshots.count(id)) return false;
+            Snapshot &snapshot = snapshots[id];
+            snapshot.seq = ++latest;
+            for (size_t i = 0; i < files.size(); ++i)
+                if (files[i].file) snapshot.images[files[i].name].size = files[i].file->size();
+            save();
+            return true;
+        }
+
+        bool restore(const std::string &id) {
+            auto it = snapshots.find(id);
+            if (it == snapshots.end()) return false;
+            char page[PageSize];
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (!files[i].file) continue;
+                auto image = it->second.images.find(files[i].name);
+                long size = 0; //files opened after the snapshot was taken come back empty
+                if (image != it->second.images.end()) {
+                    size = image->second.size;
+                    for (auto p = image->second.pages.begin(); p != image->second.pages.end(); ++p) {
+                        readPage(p->second, page);
+                        files[i].file->write(p->first * PageSize, page, PageSize); //other snapshots keep theirs
+                    }
+                }
+                files[i].file->truncate(size);
+            }
+            save();
+            return true;
+        }
+
+        bool remove(const std::string &id) {
+            auto it = snapshots.find(id);
+            if (it == snapshots.end()) return false;
+            for (auto image = it->second.images.begin(); image != it->second.images.end(); ++image)
+                for (auto p = image->second.pages.begin(); p != image->second.pages.end(); ++p)
+                    if (--refs[p->second] == 0) freePages.push_back(p->second);
+            snapshots.erase(id);
+            save();
+            return true;
+        }
+
+        int opened(Storage &file, const std::string &name) override {
+            files.push_back(OpenFile{&file, name, &written[name]});
+            return (int) files.size() - 1;
+        }
+
+        void closed(int id) override { files[id].file = nullptr; }
+
+        void beforeWrite(int id, long offset, size_t len) override {
+            if (snapshots.empty() || !len) return;
+            for (long p = offset / PageSize; p <= (offset + (long) len - 1) / PageSize; ++p) preserve(files[id], p);
+        }
+
+    private:
+        struct Image { //one file as a snapshot sees it
+            long size = 0;
+            sjtu::map<long, long> pages; //page of the file -> page in snapshot_pages, others are still shared
+        };
+
+        struct Snapshot {
+            unsigned seq = 0;
+            sjtu::map<std::string, Image> images; //by file name
+        };
+
+        struct OpenFile {
+            Storage *file;
+            std::string name;
+            sjtu::vector<unsigned> *written;
+        };
+
+        sjtu::map<std::string, Snapshot> snapshots;
+        sjtu::map<std::string, sjtu::vector<unsigned>> written;
+        //seq of the newest snapshot when each page was last written, shared with every newer one
+        sjtu::vector<OpenFile> files; //by hook id
+        sjtu::vector<int> refs; //snapshots holding each page of snapshot_pages
+        sjtu::vector<long> freePages;
+        unsigned latest = 0; //seq of the newest snapshot ever taken
+        StorageBackend *store = nullptr; //snapshot_pages, opened on first use
+        bool memory = defaultStorageKind() == StorageKind::Memory, changed = false;
+
+        Snapshots() {
+            struct stat st{};
+            if (!memory && stat("snapshot_meta", &st) == 0) load();
+        }
+
+        void preserve(OpenFile &f, long p) { //copy page p for the snapshots still sharing it
+            sjtu::vector<unsigned> &w = *f.written;
+            unsigned at = p < (long) w.size() ? w[p] : 0;
+            if (at >= latest) return; //written since the newest snapshot was taken
+            while ((long) w.size() <= p) w.push_back(0);
+            w[p] = latest;
+            changed = true;
+            long copy = -1;
+            char page[PageSize];
+            for (auto it = snapshots.begin(); it != snapshots.end(); ++it) {
+                if (it->second.seq <= at) continue; //taken before the last write, has its own copy
+                auto image = it->second.images.find(f.name);
+                if (image == it->second.images.end() || image->second.size <= p * PageSize) continue;
+                if (copy == -1) {
+                    f.file->read(p * PageSize, page, PageSize);
+                    copy = allocPage();
+                    writePage(copy, page);
+                }
+                image->second.pages[p] = copy;
+                ++refs[copy];
+            }
+        }
+
+        long allocPage() { //reuse pages of removed snapshots first
+            if (!freePages.empty()) {
+                long page = freePages.back();
+                freePages.pop_back();
+                return page;
+            }
+            refs.push_back(0);
+            return (long) refs.size() - 1;
+        }
+
+        StorageBackend *storeFile() {
+            if (!store) store = memory ? (StorageBackend *) new MemoryBackend : new PreadBackend("snapshot_pages");
+            return store;
+        }
+
+        void readPage(long page, char *buf) { storeFile()->read(page * PageSize, buf, PageSize); }
+
+        void writePage(long page, const char *buf) { storeFile()->write(page * PageSize, buf, PageSize); }
+
+        //snapshot_meta: latest, snapshots, written, refs, freePages
+
+        static void putLong(std::string &out, long x) { out.append((const char *) &x, sizeof(long)); }
+
+        static void putString(std::string &out, const std::string &str) {
+            putLong(out, (long) str.size());
+            out += str;
+        }
+
+        static long getLong(const char *&in) {
+            long x;
+            memcpy(&x, in, sizeof(long));
+            in += sizeof(long);
+            return x;
+        }
+
+        static std::string getString(const char *&in) {
+            long len = getLong(in);
+            std::string str(in, len);
+            in += len;
+            return str;
+        }
+
+        void save() {
+            changed = false;
+            if (memory) return;
+            std::string out;
+            putLong(out, latest);
+            putLong(out, (long) snapshots.size());
+            for (auto it = snapshots.begin(); it != snapshots.end(); ++it) {
+                putString(out, it->first);
+                putLong(out, it->second.seq);
+                putLong(out, (long) it->second.images.size());
+                for (auto image = it->second.images.begin(); image != it->second.images.end(); ++image) {
+                    putString(out, image->first);
+                    putLong(out, image->second.size);
+                    putLong(out, (long) image->second.pages.size());
+                    for (auto p = image->second.pages.begin(); p != image->second.pages.end(); ++p) {
+                        putLong(out, p->first);
+                        putLong(out, p->second);
+                    }
+                }
+            }
+            putLong(out, (long) written.size());
+            for (auto it = written.begin(); it != written.end(); ++it) {
+                putString(out, it->first);
+                putLong(out, (long) it->second.size());
+                for (size_t i = 0; i < it->second.size(); ++i) putLong(out, it->second[i]);
+            }
+            putLong(out, (long) refs.size());
+            for (size_t i = 0; i < refs.size(); ++i) putLong(out, refs[i]);
+            putLong(out, (long) freePages.size());
+            for (size_t i = 0; i < freePages.size(); ++i) putLong(out, freePages[i]);
+            PreadBackend meta("snapshot_meta");
+            meta.write(0, out.data(), out.size());
+            meta.truncate((long) out.size());
+        }
+
+        void load() {
+            PreadBackend meta("snapshot_meta");
+            std::string buf(meta.size(), '\0');
+            meta.read(0, &buf[0], buf.size());
+            if (buf.empty()) return;
+            const char *in = buf.data();
+            latest = (unsigned) getLong(in);
+            for (long n = getLong(in); n; --n) {
+                Snapshot &snapshot = snapshots[getString(in)];
+                snapshot.seq = (unsigned) getLong(in);
+                for (long m = getLong(in); m; --m) {
+                    Image &image = snapshot.images[getString(in)];
+                    image.size = getLong(in);
+                    for (long k = getLong(in); k; --k) {
+                        long p = getLong(in);
+                        image.pages[p] = getLong(in);
+                    }
+                }
+            }
+            for (long n = getLong(in); n; --n) {
+                sjtu::vector<unsigned> &w = written[getString(in)];
+                for (long k = getLong(in); k; --k) w.push_back((unsigned) getLong(in));
+            }
+            for (long n = getLong(in); n; --n) refs.push_back((int) getLong(in));
+            for (long n = getLong(in); n; --n) freePages.push_back(getLong(in));
+        }
+    };
+
+    inline bool snapshotsInstalled = (storageHook() = &Snapshots::instance(), true);
+    //before any tree opens its files: trees are only defined after including this header
+
+}
+
+#endif //TICKET_SYSTEM_SNAPSHOT_H
@@ -0,0 +1,813 @@
+#ifndef TICKET_SYSTEM_STORAGE_H
+#define TICKET_SYSTEM_STORAGE_H
+
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../STLite/exceptions.hpp"
+#include "../STLite/vector.hpp"
+#include "../STLite/map.hpp"
+
+/*
+ * Class: my::Storage
+ * ---------------------
+ * This class is the only way BPT, multiBPT and File touch their files.
+ * It owns one backend chosen when the file is opened:
+ *
+ *    pread  - positioned pread/pwrite on a single fd (default)
+ *    mmap   - the whole file mapped MAP_SHARED, reads are plain memcpy
+ *    memory - a growable buffer that is never persisted (ephemeral/test runs)
+ *
+ * The default backend comes from TICKET_STORAGE (pread, mmap or memory) if set,
+ * otherwise from TICKET_STORAGE_DEFAULT at compile time.
+ * Reading beyond the end of the file gives zeros.
+ *
+ *    Storage file("name");
+ *    if (file.size() == 0) {...} //new file
+ *    file.write(offset, &value, sizeof(value));
+ *    file.read(offset, &value, sizeof(value));
+ *    file.sync(); //written data is durable
+ *    file.truncate(length); //bytes beyond length read as zeros again
+ *
+ * If a StorageHook is installed (see my::Snapshots), it hears of every open file
+ * and of every range before it is overwritten. With TICKET_WAL set, writes go
+ * through the write-ahead log first (see my::Wal).
+ *
+ */
+
+/*
+ * Class: my::Wal
+ * ---------------------
+ * With TICKET_WAL=n (n > 0) every persistent Storage writes through a write-ahead log
+ * kept in two segments, "wal_0" and "wal_1":
+ *
+ *    - a write logs after-images of whole 4 KiB pages, each page at most once per
+ *      group (rewritten in place until the group commits)
+ *    - a read sees the newest logged image of a page, other pages come from the file
+ *    - endCommand() counts commands, every n-th one the caller writes back its caches
+ *      (tree headers included) and calls commit(): one commit record and one fsync
+ *    - once a segment passes WAL_CHECKPOINT_BYTES a fuzzy checkpoint starts: logging
+ *      moves on to the other segment while each later commit copies another
+ *      WAL_CHECKPOINT_PAGES pages of the old one into the files, which are synced
+ *      before the old segment is emptied
+ *    - closing a file neither commits nor checkpoints: the log keeps its pages
+ *      (reopening the file finds them again) until the next checkpoint applies them
+ *    - once every file is written back, the owner of the groups calls shutdown():
+ *      the last commit and a sharp checkpoint, so a clean stop leaves the log empty
+ *
+ * The file "wal" holds a clean-shutdown marker: Running while a process has the log
+ * open, Clean after it stopped with nothing left in the log (a stop without
+ * shutdown() leaves it Running). Opening the first Storage after a clean stop reads
+ * nothing else; after a crash it replays the committed records of both segments,
+ * older first, whether TICKET_WAL is set this time or not. Recovery is redo only:
+ * pages of a group without its commit record (or with a broken checksum) are
+ * ignored, so a crash loses at most the last n - 1 commands.
+ *
+ */
+
+#ifndef TICKET_STORAGE_DEFAULT
+#define TICKET_STORAGE_DEFAULT my::StorageKind::Pread
+#endif
+
+namespace my {
+
+    enum class StorageKind { Pread, Mmap, Memory };
+
+    class StorageBackend {
+    public:
+        virtual ~StorageBackend() = default;
+
+        virtual void read(long offset, void *buf, size_t len) = 0;
+
+        virtual void write(long offset, const void *buf, size_t len) = 0;
+
+        virtual long size() = 0;
+
+        virtual void sync() = 0;
+
+        virtual void truncate(long len) = 0;
+    };
+
+    class PreadBackend : public StorageBackend {
+    public:
+        explicit PreadBackend(const std::string &name) {
+            fd = ::open(name.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd < 0) sjtu::error("storage open fail: " + name);
+            struct stat st{};
+            fstat(fd, &st);
+            end = st.st_size;
+        }
+
+        ~PreadBackend() override { ::close(fd); }
+
+        void read(long offset, void *buf, size_t len) override {
+            auto *p = static_cast<char *>(buf);
+            while (len) {
+                ssize_t n = ::pread(fd, p, len, offset);
+                if (n == 0) { //beyond the end of file
+                    memset(p, 0, len);
+                    return;
+                }
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    sjtu::error("storage read fail");
+                }
+                p += n, offset += n, len -= n;
+            }
+        }
+
+        void write(long offset, const void *buf, size_t len) override {
+            auto *p = static_cast<const char *>(buf);
+            if (offset + (long) len > end) end = offset + (long) len;
+            while (len) {
+                ssize_t n = ::pwrite(fd, p, len, offset);
+                if (n < 0) sjtu::error("storage write fail");
+                p += n, offset += n, len -= n;
+            }
+        }
+
+        long size() override { return end; }
+
+        void sync() override { fdatasync(fd); }
+
+        void truncate(long len) override {
+            if (ftruncate(fd, len)) sjtu::error("storage truncate fail");
+            end = len;
+        }
+
+    private:
+        int fd = -1;
+        long end = 0;
+    };
+
+    class MmapBackend : public StorageBackend { //read-mostly: growing the file costs a remap
+    public:
+        explicit MmapBackend(const std::string &name) {
+            fd = ::open(name.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd < 0) sjtu::error("storage open fail: " + name);
+            struct stat st{};
+            fstat(fd, &st);
+            end = st.st_size;
+            remap(end);
+        }
+
+        ~MmapBackend() override {
+            if (map) munmap(map, capacity);
+            if (ftruncate(fd, end)) {} //drop the slack reserved for growth
+            ::close(fd);
+        }
+
+        void read(long offset, void *buf, size_t len) override {
+            if (offset >= end) {
+                memset(buf, 0, len);
+                return;
+            }
+            size_t n = offset + (long) len > end ? end - offset : len;
+            memcpy(buf, map + offset, n);
+            if (n < len) memset(static_cast<char *>(buf) + n, 0, len - n);
+        }
+
+        void write(long offset, const void *buf, size_t len) override {
+            if (offset + (long) len > capacity) remap(offset + (long) len);
+            memcpy(map + offset, buf, len);
+            if (offset + (long) len > end) end = offset + (long) len;
+        }
+
+        long size() override { return end; }
+
+        void sync() override { if (map) msync(map, capacity, MS_SYNC); }
+
+        void truncate(long len) override { //the mapping keeps its size, the slack is zeroed
+            if (len < end) memset(map + len, 0, end - len);
+            end = len;
+        }
+
+    private:
+        int fd = -1;
+        char *map = nullptr;
+        long end = 0, capacity = 0;
+
+        void remap(long need) { //map at least need bytes, doubling the mapped size
+            long newCapacity = capacity ? capacity : 1 << 16;
+            while (newCapacity < need) newCapacity <<= 1;
+            if (map) munmap(map, capacity);
+            if (ftruncate(fd, newCapacity)) sjtu::error("storage grow fail");
+            void *p = mmap(nullptr, newCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) sjtu::error("storage mmap fail");
+            map = static_cast<char *>(p);
+            capacity = newCapacity;
+        }
+    };
+
+    class MemoryBackend : public StorageBackend { //nothing is persisted
+    public:
+        ~MemoryBackend() override { free(buffer); }
+
+        void read(long offset, void *buf, size_t len) override {
+            if (offset >= end) {
+                memset(buf, 0, len);
+                return;
+            }
+            size_t n = offset + (long) len > end ? end - offset : len;
+            memcpy(buf, buffer + offset, n);
+            if (n < len) memset(static_cast<char *>(buf) + n, 0, len - n);
+        }
+
+        void write(long offset, const void *buf, size_t len) override {
+            if (offset + (long) len > capacity) {
+                long newCapacity = capacity ? capacity : 1 << 16;
+                while (newCapacity < offset + (long) len) newCapacity <<= 1;
+                buffer = static_cast<char *>(realloc(buffer, newCapacity));
+                memset(buffer + capacity, 0, newCapacity - capacity);
+                capacity = newCapacity;
+            }
+            memcpy(buffer + offset, buf, len);
+            if (offset + (long) len > end) end = offset + (long) len;
+        }
+
+        long size() override { return end; }
+
+        void sync() override {}
+
+        void truncate(long len) override {
+            if (len < end) memset(buffer + len, 0, end - len);
+            end = len;
+        }
+
+    private:
+        char *buffer = nullptr;
+        long end = 0, capacity = 0;
+    };
+
+    inline StorageKind &defaultStorageKind() { //TICKET_STORAGE overrides the compile-time default
+        static StorageKind kind = [] {
+            const char *env = getenv("TICKET_STORAGE");
+            if (env && !strcmp(env, "pread")) return StorageKind::Pread;
+            if (env && !strcmp(env, "mmap")) return StorageKind::Mmap;
+            if (env && !strcmp(env, "memory")) return StorageKind::Memory;
+            return TICKET_STORAGE_DEFAULT;
+        }();
+        return kind;
+    }
+
+    //Write-ahead log -----------------------------------------------------------------
+
+#ifndef WAL_CHECKPOINT_BYTES
+#define WAL_CHECKPOINT_BYTES (64L << 20)
+#endif
+
+#ifndef WAL_CHECKPOINT_PAGES
+#define WAL_CHECKPOINT_PAGES 64
+#endif
+
+    class WalFile;
+
+    class Wal {
+    public:
+        constexpr static long PageSize = 4096;
+
+        static Wal &instance() {
+            static Wal wal;
+            return wal;
+        }
+
+        Wal(const Wal &) = delete;
+
+        Wal &operator=(const Wal &) = delete;
+
+        ~Wal() {
+            if (!enabled()) return;
+            if (!pending()) setState(Clean); //otherwise the next start redoes what was committed
+            for (size_t i = 0; i < files.size(); ++i) dropFile(i);
+            delete segment[0];
+            delete segment[1];
+        }
+
+        inline bool enabled() const { return group > 0; }
+
+        inline bool endCommand() { //true if a group is complete and should be committed
+            if (!enabled() || ++commands < group) return false;
+            commands = 0;
+            return true;
+        }
+
+        inline void commit(); //make the group durable, then advance the fuzzy checkpoint
+
+        inline void checkpoint(); //sharp: every logged page into the files, between groups only
+
+        void shutdown() { //clean stop, once every file is written back: the last commit, then a checkpoint
+            if (!enabled()) return;
+            commit();
+            checkpoint();
+        }
+
+    private:
+        friend class WalFile;
+
+        friend class WalBackend;
+
+        struct Record {
+            long type = 0, file = 0, page = 0, end = 0; //a commit keeps its group number in file, a header its seq
+            unsigned long sum = 0; //checksum of the page image
+        };
+
+        struct Position {
+            int segment = 0;
+            long at = 0;
+        };
+
+        enum : long { NameRecord = 0x57414c31, PageRecord, CommitRecord, TruncateRecord, SegmentRecord };
+
+        enum : long { Clean = 0x434c45414e, Running = 0x52554e };
+
+        constexpr static long NameSize = 64;
+
+        PreadBackend *segment[2]{nullptr, nullptr}; //wal_0 and wal_1
+        int active = 0; //appended to, the other one is being drained or empty
+        long tail = 0, seq = 0, txn = 1, group = 0, commands = 0;
+        bool open = false, draining = false; //records written since the last commit, fuzzy checkpoint running
+        sjtu::vector<WalFile *> files; //by file id in the log, kept after closing until checkpointed
+
+        Wal() {
+            const char *env = getenv("TICKET_WAL");
+            group = env ? strtol(env, nullptr, 10) : 0;
+            if (state() == Running) recover(); //otherwise the log is empty: nothing to scan
+            if (!enabled()) return;
+            segment[0] = new PreadBackend("wal_0");
+            segment[1] = new PreadBackend("wal_1");
+            setState(Running);
+        }
+
+        static long state() { //of the last process that used the log
+            struct stat st{};
+            if (stat("wal", &st) != 0) return Clean;
+            long value = Running; //present but unreadable: assume a crash
+            PreadBackend("wal").read(0, &value, sizeof(long));
+            return value;
+        }
+
+        static void setState(long value) {
+            PreadBackend marker("wal");
+            marker.write(0, &value, sizeof(long));
+            marker.sync();
+        }
+
+        static unsigned long checksum(const char *p, long len) { //FNV-1a
+            unsigned long h = 14695981039346656037ul;
+            for (long i = 0; i < len; ++i) h = (h ^ (unsigned char) p[i]) * 1099511628211ul;
+            return h;
+        }
+
+        inline WalFile *openFile(StorageBackend *inner, const std::string &name); //a closed file of that name comes back
+
+        inline void closeFile(WalFile *file); //its pages stay in the log until the next checkpoint
+
+        inline bool pending() const; //anything logged that is not in the files yet
+
+        inline void dropFile(size_t i);
+
+        void append(const void *buf, long len) {
+            if (tail == 0) { //first record of a segment names its place in the order
+                Record r;
+                r.type = SegmentRecord, r.file = ++seq;
+                segment[active]->write(0, &r, sizeof(Record));
+                tail = sizeof(Record);
+            }
+            segment[active]->write(tail, buf, len);
+            tail += len;
+            open = true;
+        }
+
+        void logName(int id, const std::string &name) {
+            if ((long) name.size() >= NameSize) sjtu::error("wal: file name too long: " + name);
+            char buf[sizeof(Record) + NameSize]{0};
+            Record r;
+            r.type = NameRecord, r.file = id;
+            memcpy(buf, &r, sizeof(Record));
+            memcpy(buf + sizeof(Record), name.c_str(), name.size());
+            append(buf, sizeof(buf));
+        }
+
+        Position logPage(int id, long page, long end, const char *image, const Position *at) { //rewrite *at if given
+            char buf[sizeof(Record) + PageSize];
+            Record r;
+            r.type = PageRecord, r.file = id, r.page = page, r.end = end, r.sum = checksum(image, PageSize);
+            memcpy(buf, &r, sizeof(Record));
+            memcpy(buf + sizeof(Record), image, PageSize);
+            if (at) {
+                segment[at->segment]->write(at->at, buf, sizeof(buf));
+                open = true;
+                return *at;
+            }
+            append(buf, sizeof(buf));
+            return Position{active, tail - (long) sizeof(buf)};
+        }
+
+        void logTruncate(int id, long end) {
+            Record r;
+            r.type = TruncateRecord, r.file = id, r.end = end;
+            append(&r, sizeof(Record));
+        }
+
+        inline void readPage(const Position &at, char *image) {
+            segment[at.segment]->read(at.at + (long) sizeof(Record), image, PageSize);
+        }
+
+        inline void beginCheckpoint();
+
+        inline void drain(long pages); //apply up to pages logged pages of the older segment
+
+        void recover() { //redo committed pages of both segments, older first, then empty the log
+            struct Pending {
+                long type, file, page, end;
+                Position at;
+            };
+            struct Target {
+                sjtu::map<long, Position> pages; //page -> its newest committed image
+                long end = 0, limit = LONG_MAX; //file size, and bytes of the old file still valid
+            };
+            PreadBackend *in[2] = {new PreadBackend("wal_0"), new PreadBackend("wal_1")};
+            long first[2] = {0, 0};
+            for (int s = 0; s < 2; ++s) {
+                Record r;
+                if (in[s]->size() >= (long) sizeof(Record)) in[s]->read(0, &r, sizeof(Record));
+                if (r.type == SegmentRecord) first[s] = r.file;
+            }
+            sjtu::map<long, std::string> names;
+            sjtu::map<std::string, Target> targets;
+            char image[PageSize];
+            for (int k = 0; k < 2; ++k) {
+                int s = (first[0] <= first[1]) == (k == 0) ? 0 : 1;
+                if (!first[s]) continue;
+                sjtu::vector<Pending> pending;
+                long size = in[s]->size(), pos = sizeof(Record);
+                Record r;
+                while (pos + (long) sizeof(Record) <= size) {
+                    in[s]->read(pos, &r, sizeof(Record));
+                    long body = r.type == NameRecord ? NameSize : r.type == PageRecord ? PageSize : 0;
+                    if (pos + (long) sizeof(Record) + body > size) break; //torn tail
+                    if (r.type == NameRecord) {
+                        char name[NameSize];
+                        in[s]->read(pos + (long) sizeof(Record), name, NameSize);
+                        names[r.file] = std::string(name, strnlen(name, NameSize));
+                    } else if (r.type == PageRecord || r.type == TruncateRecord) {
+                        if (r.type == PageRecord) {
+                            in[s]->read(pos + (long) sizeof(Record), image, PageSize);
+                            if (checksum(image, PageSize) != r.sum) break;
+                        }
+                        pending.push_back(Pending{r.type, r.file, r.page, r.end, Position{s, pos}});
+                    } else if (r.type == CommitRecord) {
+                        for (size_t i = 0; i < pending.size(); ++i) {
+                            Target &t = targets[names[pending[i].file]];
+                            if (pending[i].type == TruncateRecord) {
+                                long cut = (pending[i].end + PageSize - 1) / PageSize;
+                                sjtu::vector<long> gone;
+                                for (auto it = t.pages.begin(); it != t.pages.end(); ++it)
+                                    if (it->first >= cut) gone.push_back(it->first);
+                                for (size_t j = 0; j < gone.size(); ++j) t.pages.erase(gone[j]);
+                                if (pending[i].end < t.limit) t.limit = pending[i].end;
+                            } else t.pages[pending[i].page] = pending[i].at;
+                            t.end = pending[i].end;
+                        }
+                        pending.clear();
+                    } else break;
+                    pos += (long) sizeof(Record) + body;
+                }
+            }
+            for (auto it = targets.begin(); it != targets.end(); ++it) {
+                PreadBackend out(it->first);
+                Target &t = it->second;
+                if (t.limit < out.size()) out.truncate(t.limit);
+                for (auto p = t.pages.begin(); p != t.pages.end(); ++p) {
+                    in[p->second.segment]->read(p->second.at + (long) sizeof(Record), image, PageSize);
+                    out.write(p->first * PageSize, image, PageSize);
+                }
+                if (out.size() > t.end) out.truncate(t.end); //whole pages were written
+                out.sync();
+            }
+            for (int s = 0; s < 2; ++s) {
+                in[s]->truncate(0);
+                in[s]->sync();
+                delete in[s];
+            }
+            setState(Clean);
+        }
+    };
+
+    class WalFile { //what the Wal knows of one file, open or not
+    public:
+        WalFile(StorageBackend *inner, const std::string &name, int id) : inner(inner), name(name), id(id) {
+            end = inner->size();
+        }
+
+        WalFile(const WalFile &) = delete;
+
+        WalFile &operator=(const WalFile &) = delete;
+
+        ~WalFile() { delete inner; }
+
+        void read(long offset, void *buf, size_t len) {
+            auto *p = static_cast<char *>(buf);
+            while (len) {
+                long in = offset % PageSize, n = (long) len < PageSize - in ? (long) len : PageSize - in;
+                readSpan(offset / PageSize, in, p, n);
+                p += n, offset += n, len -= n;
+            }
+        }
+
+        void write(long offset, const void *buf, size_t len) {
+            auto *p = static_cast<const char *>(buf);
+            char image[PageSize];
+            if (offset + (long) len > end) end = offset + (long) len;
+            while (len) {
+                long in = offset % PageSize, n = (long) len < PageSize - in ? (long) len : PageSize - in;
+                readSpan(offset / PageSize, 0, image, PageSize);
+                if (memcmp(image + in, p, n) != 0) { //unchanged pages are not logged again
+                    memcpy(image + in, p, n);
+                    logPage(offset / PageSize, image);
+                }
+                p += n, offset += n, len -= n;
+            }
+        }
+
+        long size() const { return end; }
+
+        void sync() { if (wal.segment[wal.active]) wal.segment[wal.active]->sync(); }
+
+        void truncate(long len) {
+            if (len >= end) return;
+            if (len % PageSize) { //the last page keeps zeros beyond len
+                char image[PageSize];
+                readSpan(len / PageSize, 0, image, PageSize);
+                memset(image + len % PageSize, 0, PageSize - len % PageSize);
+                end = len;
+                logPage(len / PageSize, image);
+            }
+            long first = (len + PageSize - 1) / PageSize;
+            sjtu::vector<long> gone;
+            for (auto it = pages.begin(); it != pages.end(); ++it) if (it->first >= first) gone.push_back(it->first);
+            for (size_t i = 0; i < gone.size(); ++i) pages.erase(gone[i]);
+            for (auto it = pages.begin(); it != pages.end(); ++it) it->second.txn = 0; //later images go after the record
+            end = len;
+            if (len < limit) limit = len;
+            if (!named) wal.logName(id, name), named = true;
+            wal.logTruncate(id, len);
+        }
+
+    private:
+        friend class Wal;
+
+        constexpr static long PageSize = Wal::PageSize;
+
+        struct Entry {
+            Wal::Position at; //newest image in the log
+            long txn = 0; //group that wrote it
+        };
+
+        Wal &wal = Wal::instance();
+        StorageBackend *inner;
+        std::string name;
+        sjtu::map<long, Entry> pages; //logged since the file last caught up with the log
+        sjtu::vector<long> draining; //pages the fuzzy checkpoint has yet to apply
+        long end = 0, limit = LONG_MAX; //size, and bytes of inner that are still valid
+        int id = -1;
+        bool named = false; //name record written to the active segment
+        bool attached = true; //a WalBackend has it open
+
+        inline bool applied() const { return pages.empty() && limit == LONG_MAX; } //the file holds all of it
+
+        void readSpan(long page, long in, char *out, long n) {
+            auto it = pages.find(page);
+            if (it != pages.end()) {
+                char image[PageSize];
+                wal.readPage(it->second.at, image);
+                memcpy(out, image + in, n);
+                return;
+            }
+            long offset = page * PageSize + in, valid = limit - offset;
+            if (valid >= n) inner->read(offset, out, n);
+            else {
+                if (valid > 0) inner->read(offset, out, valid);
+                else valid = 0;
+                memset(out + valid, 0, n - valid);
+            }
+        }
+
+        void logPage(long page, const char *image) {
+            if (!named) wal.logName(id, name), named = true;
+            auto it = pages.find(page);
+            if (it != pages.end() && it->second.txn == wal.txn) wal.logPage(id, page, end, image, &it->second.at);
+            else pages[page] = Entry{wal.logPage(id, page, end, image, nullptr), wal.txn};
+        }
+
+        void truncateInner() { //the log holds everything beyond limit
+            if (limit < inner->size()) inner->truncate(limit);
+            limit = LONG_MAX;
+        }
+
+        void beginDrain() { //all pages logged so far are in the segment that is now older
+            truncateInner();
+            draining.clear();
+            for (auto it = pages.begin(); it != pages.end(); ++it) draining.push_back(it->first);
+            named = false;
+        }
+
+        long drain(long budget) { //apply up to budget pages, return how many were applied
+            long applied = 0;
+            char image[PageSize];
+            while (applied < budget && !draining.empty()) {
+                long page = draining.back();
+                draining.pop_back();
+                auto it = pages.find(page);
+                if (it == pages.end() || it->second.at.segment == wal.active) continue; //gone or logged again
+                wal.readPage(it->second.at, image);
+                inner->write(page * PageSize, image, PageSize);
+                pages.erase(page);
+                ++applied;
+            }
+            return applied;
+        }
+
+        void finishDrain() {
+            if (inner->size() > end) inner->truncate(end); //whole pages were written
+            inner->sync();
+        }
+
+        void apply() { //sharp checkpoint: move every logged page into the file
+            truncateInner();
+            char image[PageSize];
+            for (auto it = pages.begin(); it != pages.end(); ++it) {
+                wal.readPage(it->second.at, image);
+                inner->write(it->first * PageSize, image, PageSize);
+            }
+            pages.clear();
+            draining.clear();
+            finishDrain();
+            named = false;
+        }
+    };
+
+    class WalBackend : public StorageBackend { //a file whose writes go through the Wal
+    public:
+        WalBackend(StorageBackend *inner, const std::string &name) : file(Wal::instance().openFile(inner, name)) {}
+
+        ~WalBackend() override { Wal::instance().closeFile(file); } //detach only, the owner commits
+
+        void read(long offset, void *buf, size_t len) override { file->read(offset, buf, len); }
+
+        void write(long offset, const void *buf, size_t len) override { file->write(offset, buf, len); }
+
+        long size() override { return file->size(); }
+
+        void sync() override { file->sync(); }
+
+        void truncate(long len) override { file->truncate(len); }
+
+    private:
+        WalFile *file;
+    };
+
+    WalFile *Wal::openFile(StorageBackend *inner, const std::string &name) {
+        for (size_t i = 0; i < files.size(); ++i)
+            if (files[i] && !files[i]->attached && files[i]->name == name) { //its own view of the file is newer
+                delete inner;
+                files[i]->attached = true;
+                return files[i];
+            }
+        files.push_back(new WalFile(inner, name, (int) files.size()));
+        return files.back();
+    }
+
+    void Wal::closeFile(WalFile *file) {
+        file->attached = false;
+        if (file->applied()) dropFile(file->id);
+    }
+
+    bool Wal::pending() const {
+        if (open || draining) return true;
+        for (size_t i = 0; i < files.size(); ++i) if (files[i] && !files[i]->applied()) return true;
+        return false;
+    }
+
+    void Wal::dropFile(size_t i) { //closed and applied, or the Wal is going away
+        delete files[i];
+        files[i] = nullptr;
+    }
+
+    void Wal::commit() {
+        if (!open) return;
+        Record r;
+        r.type = CommitRecord, r.file = txn++;
+        append(&r, sizeof(Record));
+        open = false;
+        segment[active]->sync();
+        if (draining) drain(WAL_CHECKPOINT_PAGES);
+        if (tail >= WAL_CHECKPOINT_BYTES) beginCheckpoint();
+    }
+
+    void Wal::beginCheckpoint() { //fuzzy: switch segments, the files catch up over the next groups
+        if (draining) drain(LONG_MAX); //the other segment must be empty before it is reused
+        active ^= 1;
+        tail = 0;
+        draining = true;
+        for (size_t i = 0; i < files.size(); ++i) if (files[i]) files[i]->beginDrain();
+    }
+
+    void Wal::drain(long pages) {
+        for (size_t i = 0; i < files.size() && pages > 0; ++i) if (files[i]) pages -= files[i]->drain(pages);
+        if (pages <= 0) return;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (!files[i]) continue;
+            files[i]->finishDrain();
+            if (!files[i]->attached && files[i]->applied()) dropFile(i);
+        }
+        segment[active ^ 1]->truncate(0); //the files now hold all of it
+        segment[active ^ 1]->sync();
+        draining = false;
+    }
+
+    void Wal::checkpoint() {
+        if (!enabled() || open) return;
+        segment[active]->sync(); //the files are only touched once the log is durable
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (!files[i]) continue;
+            files[i]->apply();
+            if (!files[i]->attached) dropFile(i);
+        }
+        for (int s = 0; s < 2; ++s) {
+            segment[s]->truncate(0);
+            segment[s]->sync();
+        }
+        tail = 0;
+        draining = false;
+    }
+
+    class Storage;
+
+    class StorageHook { //told about every Storage and every range before it is overwritten
+    public:
+        virtual ~StorageHook() = default;
+
+        virtual int opened(Storage &file, const std::string &name) = 0; //id passed to the calls below
+
+        virtual void closed(int id) = 0;
+
+        virtual void beforeWrite(int id, long offset, size_t len) = 0;
+    };
+
+    inline StorageHook *&storageHook() {
+        static StorageHook *hook = nullptr;
+        return hook;
+    }
+
+    class Storage {
+    public:
+        explicit Storage(const std::string &name, StorageKind kind = defaultStorageKind()) {
+            Wal &wal = Wal::instance(); //replays a crashed log before any file is opened
+            if (kind == StorageKind::Mmap) backend = new MmapBackend(name);
+            else if (kind == StorageKind::Memory) backend = new MemoryBackend;
+            else backend = new PreadBackend(name);
+            if (kind != StorageKind::Memory && wal.enabled()) backend = new WalBackend(backend, name);
+            if (storageHook()) hookId = storageHook()->opened(*this, name);
+        }
+
+        Storage(const Storage &) = delete;
+
+        Storage &operator=(const Storage &) = delete;
+
+        ~Storage() {
+            if (~hookId && storageHook()) storageHook()->closed(hookId);
+            delete backend;
+        }
+
+        inline void read(long offset, void *buf, size_t len) { backend->read(offset, buf, len); }
+
+        inline void write(long offset, const void *buf, size_t len) {
+            if (~hookId && storageHook()) storageHook()->beforeWrite(hookId, offset, len);
+            backend->write(offset, buf, len);
+        }
+
+        inline long size() { return backend->size(); }
+
+        inline void sync() { backend->sync(); }
+
+        void truncate(long len) {
+            if (len >= size()) return;
+            if (~hookId && storageHook()) storageHook()->beforeWrite(hookId, len, size() - len);
+            backend->truncate(len);
+        }
+
+    private:
+        StorageBackend *backend = nullptr;
+        int hookId = -1;
+    };
+
+}
+
+#endif //TICKET_SYSTEM_STORAGE_H
@@ -0,0 +1,53 @@
+#ifndef TICKET_SYSTEM_TRAITS_H
+#define TICKET_SYSTEM_TRAITS_H
+
+#include <cstddef>
+#include "storage.h"
+#include "cache.h"
+#include "key.h"
+
+/*
+ * Struct: my::TreeTraits
+ * ---------------------
+ * Compile-time policies of a BPT or multiBPT, given as their last template argument.
+ * A tree tuned for its access pattern overrides only what it needs:
+ *
+ *    struct Scanned : my::TreeTraits {
+ *        constexpr static CachePolicy cache = CachePolicy::TwoQ; //scans do not evict hot nodes
+ *    };
+ *
+ *    BPT<key_type, value_type, Scanned> map("file");
+ *
+ * The policies are:
+ *
+ *    storage()  backend of the tree files, TICKET_STORAGE (see storage.h) unless overridden
+ *    cache      replacement policy of the node cache, and of the value file of a BPT
+ *    pinPages   pages of internal nodes kept resident from the start (see Cache::setPinBudget)
+ *    values     BPT only: Auto keeps values in leaves while 9 entries still fit, else in a file
+ *    key<K>     what nodes keep of a key and compare, my::stored_key<K> (see key.h), or K itself
+ *
+ * All of them are resolved at compile time or once in the constructor,
+ * so nothing on the hot path goes through a virtual call.
+ *
+ */
+
+namespace my {
+
+    enum class ValuePlacement { Auto, Inline, External };
+
+    struct TreeTraits {
+        static StorageKind storage() { return defaultStorageKind(); }
+
+        constexpr static CachePolicy cache = CachePolicy::LRU;
+
+        constexpr static size_t pinPages = 0; //TICKET_PIN_PAGES overrides it at run time
+
+        constexpr static ValuePlacement values = ValuePlacement::Auto;
+
+        template<class K>
+        using key = stored_key<K>;
+    };
+
+}
+
+#endif //TICKET_SYSTEM_TRAITS_H
@@ -37,7 +37,7 @@ namespace sjtu {
             Node(const value_type &v, Node *fa, Node *ls = nullptr, Node *rs = nullptr, int height = 1) :
                     fa(fa), ls(ls), rs(rs), height(height) { data = new value_type(v); }
 
-            inline void updateH() { if (this) height = std::max(h(ls), h(rs)) + 1; }
+            inline void updateH() { height = std::max(h(ls), h(rs)) + 1; }
         };
 
     private: // AVL tree
@@ -378,7 +378,7 @@ namespace sjtu {
              * for the support of it->first.
              * See <http://kelvinh.github.io/blog/2013/11/20/overloading-of-member-access-operator-dash-greater-than-symbol-in-cpp/> for help.
              */
-            value_type *operator->() const noexcept {
+            value_type *operator->() const {
                 if (p == nullptr) throw invalid_iterator();
                 return p->data;
             }
@@ -449,7 +449,7 @@ namespace sjtu {
 
             bool operator!=(const const_iterator &rhs) const { return p != rhs.p || id != rhs.id; }
 
-            const value_type *operator->() const noexcept {
+            const value_type *operator->() const {
                 if (p == nullptr) throw invalid_iterator();
                 return p->data;
             }
@@ -23,10 +23,9 @@ namespace my {
             strcpy(str, s.c_str());
         }
 
-        string<len> &operator=(const string<len> &s) {
-            if (this != &s) { strcpy(str, s.str); }
-            return *this;
-        }
+        string(const string<len> &s) = default;
+
+        string<len> &operator=(const string<len> &s) = default; //whole buffer, so the type stays trivially copyable
 
         string<len> &operator=(const char *s) {
             memset(str, 0, sizeof(str));
@@ -99,6 +98,20 @@ namespace my {
 
         inline char *c_str() { return str; }
 
+        constexpr static size_t EncodedSize = len; //see my::key_encoding_traits
+
+        void encode(unsigned char *out) const { //zero padded, so memcmp orders like strcmp
+            size_t n = strnlen(str, len);
+            memcpy(out, str, n);
+            memset(out + n, 0, len - n);
+        }
+
+        static string decode(const unsigned char *in) {
+            string s;
+            memcpy(s.str, in, len);
+            return s;
+        }
+
         [[nodiscard]] inline int hash() const { //Daniel J. Bernstein Hash Function
             int h = 5381;
             for (const char *s = str; *s; ++s) h += (h << 5) + *s;
@@ -257,12 +257,12 @@ namespace sjtu {
          * throw index_out_of_bound if pos is not in [0, size)
          */
         T &at(const size_t &pos) {
-            if (pos < 0 || pos >= size_) throw index_out_of_bound();
+            if (pos >= (size_t) size_) throw index_out_of_bound();
             return data[pos];
         }
 
         const T &at(const size_t &pos) const {
-            if (pos < 0 || pos >= size_) throw index_out_of_bound();
+            if (pos >= (size_t) size_) throw index_out_of_bound();
             return data[pos];
         }
 
@@ -273,12 +273,12 @@ namespace sjtu {
          *   In STL this operator does not check the boundary but I want you to do.
          */
         T &operator[](const size_t &pos) {
-            if (pos < 0 || pos >= size_) throw index_out_of_bound();
+            if (pos >= (size_t) size_) throw index_out_of_bound();
             return data[pos];
         }
 
         const T &operator[](const size_t &pos) const {
-            if (pos < 0 || pos >= size_) throw index_out_of_bound();
+            if (pos >= (size_t) size_) throw index_out_of_bound();
             return data[pos];
         }
 
@@ -1,6 +1,8 @@
+#include <cstdlib>
 #include "src/userSystem.h"
 #include "src/simpleScanner.h"
 #include "src/trainSystem.h"
+#include "B+Tree/snapshot.h"
 
 using std::cout;
 
@@ -14,12 +16,28 @@ int main() {
     std::ios::sync_with_stdio(false);
     std::cin.tie(nullptr);
     std::cout.tie(nullptr);
+    if (const char *pages = getenv("TICKET_POOL_PAGES")) //size the buffer pool to the memory limit
+        BufferPool::instance().setBudget(strtoul(pages, nullptr, 10));
+    if (const char *pages = getenv("TICKET_PIN_PAGES")) { //keep internal nodes of every tree resident
+        userSystem.pinInternal(strtoul(pages, nullptr, 10));
+        trainSystem.pinInternal(strtoul(pages, nullptr, 10));
+    }
     std::string input;
     while (!quit) {
         if (std::cin.eof()) break;
         getline(std::cin, input);
         if (input.empty()) continue;
         processLine(input);
+        if (my::Wal::instance().endCommand()) { //group commit, see my::Wal
+            userSystem.flush();
+            trainSystem.flush();
+            my::Wal::instance().commit();
+        }
+    }
+    if (my::Wal::instance().enabled()) { //the last group: every file written back, then one commit and checkpoint
+        userSystem.flush();
+        trainSystem.flush();
+        my::Wal::instance().shutdown();
     }
     return 0;
 }
@@ -39,6 +57,26 @@ void processLine(const std::string &line) {
         userSystem.clean();
         trainSystem.clean();
         cout << "0\n";
+    } else if (token == "create_snapshot" || token == "restore_snapshot" || token == "delete_snapshot") { //R
+        std::string id;
+        while (scanner.hasMoreTokens()) {
+            if (scanner.getKey() == 'i') id = scanner.nextToken();
+            else sjtu::error(token + " failed");
+        }
+        my::Snapshots &snapshots = my::Snapshots::instance();
+        bool done;
+        if (token == "create_snapshot") {
+            userSystem.flush(); //the snapshot sees only what is in the files
+            trainSystem.flush();
+            done = snapshots.create(id);
+        } else if (token == "restore_snapshot") {
+            done = snapshots.restore(id);
+            if (done) {
+                userSystem.reload();
+                trainSystem.reload();
+            }
+        } else done = snapshots.remove(id);
+        cout << (done ? "0\n" : "-1\n");
     } else if (token == "add_user") { //N
         std::string c;
         User user;
@@ -141,8 +179,8 @@ void processLine(const std::string &line) {
         userSystem.modify_profile(c, u, p, n, m, g);
     } else if (token == "add_train") { //N
         std::string ii, ss, pp, tt, oo, dd, xx;
-        char y;
-        int n, m;
+        char y = 0;
+        int n = 0, m = 0;
         while (scanner.hasMoreTokens()) {
             switch (scanner.getKey()) {
                 case 'i':
@@ -185,20 +223,20 @@ void processLine(const std::string &line) {
         Date d1(slicer[0]), d2(slicer[1]);
         int p[N]{0}, t[N]{0}, o[N]{0};
         slicer.reset(pp);
-        for (int j = 0; j < slicer.size(); ++j) p[j] = stoi(slicer[j]);
+        for (int j = 0; j < (int) slicer.size(); ++j) p[j] = stoi(slicer[j]);
         slicer.reset(tt);
-        for (int j = 0; j < slicer.size(); ++j) t[j] = stoi(slicer[j]);
+        for (int j = 0; j < (int) slicer.size(); ++j) t[j] = stoi(slicer[j]);
         int *op = nullptr;
         if (oo != "_") {
             slicer.reset(oo);
-            for (int j = 0; j < slicer.size(); ++j) o[j] = stoi(slicer[j]);
+            for (int j = 0; j < (int) slicer.size(); ++j) o[j] = stoi(slicer[j]);
             op = o;
         }
         my::string<30> s[N];
         slicer.reset(ss);
-        for (int j = 0; j < slicer.size(); ++j) s[j] = slicer[j];
-        Train train(i, n, m, s, p, x, t, op, d1, d2, y);
-        cout << trainSystem.add_train(train) << '\n';
+        for (int j = 0; j < (int) slicer.size(); ++j) s[j] = slicer[j];
+        Train train(i, n, m, p, x, t, op, d1, d2, y);
+        cout << trainSystem.add_train(train, s) << '\n';
     } else if (token == "delete_train") { //N
         if (scanner.getKey() != 'i') sjtu::error("delete_train failed");
         auto i = scanner.nextToken();
@@ -270,7 +308,7 @@ void processLine(const std::string &line) {
     } else if (token == "buy_ticket") { //SF
         std::string u, i, d, f, t;
         bool q = false; //pending, initially false
-        int n;
+        int n = 0;
         while (scanner.hasMoreTokens()) {
             switch (scanner.getKey()) {
                 case 'u':
@@ -0,0 +1,181 @@
+#ifndef TICKET_SYSTEM_SEAT_RANGE_H
+#define TICKET_SYSTEM_SEAT_RANGE_H
+
+#include <climits>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * this file implements the range-min / range-add kernels on remaining seats and SeatTree
+ *
+ * remain[i] is the number of seats left from station i to station i + 1, and an order
+ * from l to r takes the lanes l ~ r - 1. SeatKernel works on the array in place,
+ * 8 lanes a step with AVX2, 4 with SSE4.1 or SSE2, one at a time otherwise:
+ * build with -mavx2 or -msse4.1 (TICKET_NATIVE in CMakeLists.txt) to get the wide ones.
+ * Seats never exceed 100000, but lanes stay 32-bit: a 16-bit lane would not hold them.
+ *
+ * SeatTree is the segment-tree variant, for many orders checked against one long route
+ * (e.g. the pending queue in refund_ticket): build it from the array, then every min and
+ * modify is O(log Lanes), and store() writes the result back.
+ * It only wins from about SeatTreeLanes lanes on (later still with AVX2), far beyond N now;
+ * define TICKET_SEAT_TREE_LANES to move the threshold, e.g. 1 to always take the tree.
+ */
+
+#ifndef TICKET_SEAT_TREE_LANES
+#define TICKET_SEAT_TREE_LANES 1024
+#endif
+
+constexpr int SeatTreeLanes = TICKET_SEAT_TREE_LANES;
+
+struct SeatKernel {
+    static int min(const int *a, int l, int r) { //min of a[l..r], INT_MAX if empty
+        int n = r - l + 1;
+        if (n <= 0) return INT_MAX;
+        a += l;
+#if defined(__AVX2__)
+        if (n >= 8) { //the last step overlaps the previous ones instead of a scalar tail
+            __m256i m = _mm256_loadu_si256((const __m256i *) (a + n - 8));
+            for (int i = 0; i + 8 < n; i += 8) m = _mm256_min_epi32(m, _mm256_loadu_si256((const __m256i *) (a + i)));
+            __m128i x = _mm_min_epi32(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+            x = _mm_min_epi32(x, _mm_shuffle_epi32(x, 0x4e));
+            x = _mm_min_epi32(x, _mm_shuffle_epi32(x, 0xb1));
+            return _mm_cvtsi128_si32(x);
+        }
+#elif defined(__SSE4_1__) || defined(__SSE2__)
+        if (n >= 4) {
+            __m128i m = _mm_loadu_si128((const __m128i *) (a + n - 4));
+            for (int i = 0; i + 4 < n; i += 4) m = min4(m, _mm_loadu_si128((const __m128i *) (a + i)));
+            m = min4(m, _mm_shuffle_epi32(m, 0x4e));
+            m = min4(m, _mm_shuffle_epi32(m, 0xb1));
+            return _mm_cvtsi128_si32(m);
+        }
+#endif
+        int tmp = a[0];
+        for (int i = 1; i < n; ++i) if (a[i] < tmp) tmp = a[i];
+        return tmp;
+    }
+
+    static void add(int *a, int l, int r, int add) { //a[l..r] += add
+        int i = l;
+#if defined(__AVX2__)
+        __m256i v = _mm256_set1_epi32(add);
+        for (; i + 8 <= r + 1; i += 8) {
+            auto *p = (__m256i *) (a + i);
+            _mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), v));
+        }
+#elif defined(__SSE4_1__) || defined(__SSE2__)
+        __m128i v = _mm_set1_epi32(add);
+        for (; i + 4 <= r + 1; i += 4) {
+            auto *p = (__m128i *) (a + i);
+            _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), v));
+        }
+#endif
+        for (; i <= r; ++i) a[i] += add;
+    }
+
+private:
+#if !defined(__AVX2__) && (defined(__SSE4_1__) || defined(__SSE2__))
+
+    static inline __m128i min4(__m128i x, __m128i y) {
+#if defined(__SSE4_1__)
+        return _mm_min_epi32(x, y);
+#else
+        __m128i lt = _mm_cmplt_epi32(x, y);
+        return _mm_or_si128(_mm_and_si128(lt, x), _mm_andnot_si128(lt, y));
+#endif
+    }
+
+#endif
+};
+
+//-------------------------------------------------------------------------------------------
+
+template<int Lanes>
+class SeatTree { //range add, range min over Lanes lanes, bottom-up with lazy adds
+private:
+    constexpr static int height() {
+        int h = 0;
+        while ((1 << h) < Lanes) ++h;
+        return h;
+    }
+
+    constexpr static int H = height(), Size = 1 << H;
+
+    int t[2 * Size]; //t[p]: min of the subtree of p, including the adds kept at p and below
+    int d[Size]; //add pending for both children of p
+
+    inline void apply(int p, int v) {
+        t[p] += v;
+        if (p < Size) d[p] += v;
+    }
+
+    inline void pull(int p) { //recompute the ancestors of p
+        for (p >>= 1; p; p >>= 1) t[p] = (t[2 * p] < t[2 * p + 1] ? t[2 * p] : t[2 * p + 1]) + d[p];
+    }
+
+    inline void push(int p) { //hand the adds above p down to it
+        for (int s = H; s > 0; --s) {
+            int i = p >> s;
+            if (d[i]) {
+                apply(2 * i, d[i]);
+                apply(2 * i + 1, d[i]);
+                d[i] = 0;
+            }
+        }
+    }
+
+public:
+    SeatTree() = default;
+
+    explicit SeatTree(const int *a) { load(a); }
+
+    void load(const int *a) { //Lanes entries
+        memcpy(t + Size, a, sizeof(int) * Lanes);
+        for (int i = Lanes; i < Size; ++i) t[Size + i] = INT_MAX;
+        memset(d, 0, sizeof(d));
+        for (int p = Size - 1; p; --p) t[p] = t[2 * p] < t[2 * p + 1] ? t[2 * p] : t[2 * p + 1];
+    }
+
+    void store(int *a) { //Lanes entries
+        for (int p = 1; p < Size; ++p) {
+            if (d[p]) {
+                apply(2 * p, d[p]);
+                apply(2 * p + 1, d[p]);
+                d[p] = 0;
+            }
+        }
+        memcpy(a, t + Size, sizeof(int) * Lanes);
+    }
+
+    int min(int l, int r) { //min of lanes l ~ r, INT_MAX if empty
+        if (l > r) return INT_MAX;
+        l += Size, r += Size + 1;
+        push(l), push(r - 1);
+        int tmp = INT_MAX;
+        for (; l < r; l >>= 1, r >>= 1) {
+            if (l & 1) tmp = t[l] < tmp ? t[l] : tmp, ++l;
+            if (r & 1) --r, tmp = t[r] < tmp ? t[r] : tmp;
+        }
+        return tmp;
+    }
+
+    void modify(int l, int r, int v) { //lanes l ~ r += v
+        if (l > r) return;
+        l += Size, r += Size + 1;
+        int l0 = l, r0 = r - 1;
+        for (; l < r; l >>= 1, r >>= 1) {
+            if (l & 1) apply(l++, v);
+            if (r & 1) apply(--r, v);
+        }
+        pull(l0), pull(r0);
+    }
+};
+
+#endif //TICKET_SYSTEM_SEAT_RANGE_H
@@ -68,7 +68,7 @@ SimpleScanner::SimpleScanner(std::string input) : src_str(std::move(input)) {
 }
 
 bool SimpleScanner::hasMoreTokens() const {
-    return index < tokens.size();
+    return index < (int) tokens.size();
 }
 
 std::string SimpleScanner::nextToken() {
@@ -3,8 +3,11 @@
 
 #include "../B+Tree/BPT.h"
 #include "../B+Tree/multi_BPT.h"
+#include "../B+Tree/dictionary.h"
+#include "../B+Tree/heap.h"
 #include "../STLite/algorithm.h"
 #include "myStruct.h"
+#include "seatRange.h"
 #include <cstring>
 #include <utility>
 
@@ -16,11 +19,11 @@ class Train {
 public:
     my::string<20> trainID;
     int stationNum = 2; //2 ~ N
-    my::string<30> stations[N];
+    unsigned stations[N]{0}; //station ids, see TrainSystem::station_dict
     int seat = 0;
-    int prices[N]{0}; //stationNum - 1
     Time startTime; //for every day during Date begin to end!
-    int travelTimes[N]{0}, stopoverTimes[N]{0}; //stationNum - 1/2
+    int price[N]{0}; //prefix sums: price from stations[0] to stations[i]
+    int arrive[N]{0}, leave[N]{0}; //minutes after startTime of the first day, arrive[0] = leave[0] = 0
     Date beginDate, endDate; //saleDate
     char type = 0;
 
@@ -32,31 +35,91 @@ public:
 
     explicit Train(const char *id) : trainID(id) {}
 
-    Train(const my::string<20> &i, int n, int m, const my::string<30> *s, const int *p, const Time &x,
+    Train(const my::string<20> &i, int n, int m, const int *p, const Time &x,
           const int *t, const int *o, const Date &d_begin, const Date &d_end, char y) :
             trainID(i), stationNum(n), seat(m), startTime(x), beginDate(d_begin), endDate(d_end), type(y) {
-        for (int ii = 0; ii < stationNum; ++ii) stations[ii] = s[ii];
-        memcpy(prices, p, sizeof(int) * (stationNum - 1));
-        memcpy(travelTimes, t, sizeof(int) * (stationNum - 1));
-        memcpy(stopoverTimes, o, sizeof(int) * (stationNum - 2));
+        //p: prices, t: travel times (stationNum - 1 each), o: stopover times (stationNum - 2)
+        for (int j = 1; j < stationNum; ++j) {
+            price[j] = price[j - 1] + p[j - 1];
+            arrive[j] = leave[j - 1] + t[j - 1];
+            leave[j] = j == stationNum - 1 ? arrive[j] : arrive[j] + o[j - 1];
+        }
+    }
+
+    constexpr static size_t HeadSize = sizeof(my::string<20>) + sizeof(int) * 2 + sizeof(Time) + sizeof(Date) * 2 + 1;
+
+    constexpr static size_t MaxSize = HeadSize + sizeof(unsigned) * N + sizeof(int) * (3 * N - 4);
+
+    inline size_t encodedSize() const { //head, then every array cut to stationNum
+        return HeadSize + sizeof(unsigned) * stationNum + sizeof(int) * (3 * stationNum - 4);
+    }
+
+    void encode(unsigned char *out) const { //encodedSize() bytes
+        out = put(out, &trainID, sizeof(trainID));
+        out = put(out, &stationNum, sizeof(int));
+        out = put(out, &seat, sizeof(int));
+        out = put(out, &startTime, sizeof(Time));
+        out = put(out, &beginDate, sizeof(Date));
+        out = put(out, &endDate, sizeof(Date));
+        out = put(out, &type, 1);
+        out = put(out, stations, sizeof(unsigned) * stationNum);
+        out = put(out, price + 1, sizeof(int) * (stationNum - 1)); //the zeros and leave[] of the last station
+        out = put(out, arrive + 1, sizeof(int) * (stationNum - 1)); //are not written
+        put(out, leave + 1, sizeof(int) * (stationNum - 2));
+    }
+
+    void decode(const unsigned char *in) { //only the entries the train uses are written
+        in = get(in, &trainID, sizeof(trainID));
+        in = get(in, &stationNum, sizeof(int));
+        in = get(in, &seat, sizeof(int));
+        in = get(in, &startTime, sizeof(Time));
+        in = get(in, &beginDate, sizeof(Date));
+        in = get(in, &endDate, sizeof(Date));
+        in = get(in, &type, 1);
+        in = get(in, stations, sizeof(unsigned) * stationNum);
+        in = get(in, price + 1, sizeof(int) * (stationNum - 1));
+        in = get(in, arrive + 1, sizeof(int) * (stationNum - 1));
+        get(in, leave + 1, sizeof(int) * (stationNum - 2));
+        price[0] = arrive[0] = leave[0] = 0;
+        leave[stationNum - 1] = arrive[stationNum - 1];
     }
 
-    inline int getPrice(int l, int r) {
-        int tmp = 0;
-        for (int i = l; i <= r; ++i) tmp += prices[i];
-        return tmp;
+    inline int getPrice(int l, int r) const { return price[r + 1] - price[l]; } //from stations[l] to stations[r + 1]
+
+private:
+    static inline unsigned char *put(unsigned char *out, const void *p, size_t n) {
+        memcpy(out, p, n);
+        return out + n;
+    }
+
+    static inline const unsigned char *get(const unsigned char *in, void *p, size_t n) {
+        memcpy(p, in, n);
+        return in + n;
     }
 };
 
+static_assert(Train::MaxSize <= my::Heap::MaxRecord, "a train must fit in one heap record");
+
 class TrainSystem {
     using ustring = my::string<20>;
     using sstring = my::string<30>;
+
+    struct Scanned : my::TreeTraits { //walked by every query: a scan must not evict the hot nodes
+        constexpr static CachePolicy cache = CachePolicy::TwoQ;
+    };
+
+    struct SeatTraits : Scanned { //seats are rewritten by every order, one page per update
+        constexpr static my::ValuePlacement values = my::ValuePlacement::Inline;
+    };
 public:
-    TrainSystem() : train_map("train_map"), released_trains("released_trains"),
-                    seats_map("seats_map"), stop_multimap("stop_multimap"),
+    TrainSystem() : station_dict("station"), train_dict("train"), train_heap("train_heap"), train_map("train_map"),
+                    released_trains("released_trains"), seats_map("seats_map"), stop_multimap("stop_multimap"),
                     pending_order("pending_order"), order_u("order_u") {}
 
     void clean() {
+        station_dict.clear();
+        train_dict.clear();
+        train_heap.clear();
         train_map.clear();
         released_trains.clear();
         seats_map.clear();
@@ -65,65 +128,101 @@ public:
         pending_order.clear();
     }
 
-    int add_train(const Train &train) {
-        if (train_map.count(train.trainID) || released_trains.count(train.trainID)) return -1;
-        train_map.assign(train.trainID, train);
+    void flush() {
+        station_dict.flush();
+        train_dict.flush();
+        train_heap.flush();
+        train_map.flush();
+        released_trains.flush();
+        seats_map.flush();
+        stop_multimap.flush();
+        pending_order.flush();
+        order_u.flush();
+    }
+
+    void reload() { //after restoring a snapshot
+        station_dict.reload();
+        train_dict.reload();
+        train_heap.reload();
+        train_map.reload();
+        released_trains.reload();
+        seats_map.reload();
+        stop_multimap.reload();
+        pending_order.reload();
+        order_u.reload();
+    }
+
+    void pinInternal(size_t pages) { //pages per tree
+        train_map.pinInternal(pages);
+        released_trains.pinInternal(pages);
+        seats_map.pinInternal(pages);
+        stop_multimap.pinInternal(pages);
+        pending_order.pinInternal(pages);
+        order_u.pinInternal(pages);
+    }
+
+    int add_train(Train &train, const sstring *stations) { //stations by name, interned here
+        unsigned id = train_dict.intern(train.trainID); //kept if the train is deleted or rejected
+        if (train_map.count(id) || released_trains.count(id)) return -1;
+        for (int j = 0; j < train.stationNum; ++j) train.stations[j] = station_dict.intern(stations[j]);
+        train_map.assign(id, write_train(train));
         return 0;
     }
 
     int delete_train(const std::string &i) {
-        if (train_map.erase(ustring(i))) return 0;
-        return -1;
+        unsigned id;
+        long address;
+        if (!train_dict.find(ustring(i), id) || !train_map.find(id, address)) return -1;
+        train_map.erase(id);
+        train_heap.del(address);
+        return 0;
     }
 
     int release_train(const std::string &i) {
-        ustring id(i);
-        if (!train_map.count(id) || released_trains.count(id)) return -1;
-        Train train = train_map[id];
+        unsigned id;
+        long address;
+        if (!train_dict.find(ustring(i), id) || !train_map.find(id, address) || released_trains.count(id)) return -1;
         train_map.erase(id);
-        released_trains.assign(id, train); //released_trains modify only for here
+        released_trains.assign(id, address); //released_trains modify only for here, the record stays
+        Train train;
+        read_train(address, train);
         //add Seat and Stop information
         Seat seat(train);
-        Index index;
-        index.id = id;
-        for (Date date = train.beginDate; date <= train.endDate; ++date) {
-            index.date = date;
-            seats_map.assign(index, seat);
-        }
-        Stop stop(i);
+        for (Date date = train.beginDate; date <= train.endDate; ++date) seats_map.assign(Index(id, date), seat);
+        Stop stop(id);
         stop.beginDate = train.beginDate;
         stop.endDate = train.endDate;
         Date_Time t = {train.beginDate, train.startTime};
-        stop.index = 0;
-        stop.arrive = stop.leave = t;
-        stop_multimap.insert(train.stations[0], stop);
-        t += train.travelTimes[0];
-        for (int j = 1; j < train.stationNum; ++j) {
+        for (int j = 0; j < train.stationNum; ++j) {
             stop.index = j;
-            stop.arrive = t;
-            if (j != train.stationNum - 1) t += train.stopoverTimes[j - 1];
-            stop.leave = t;
+            stop.arrive = t + train.arrive[j];
+            stop.leave = t + train.leave[j];
             stop_multimap.insert(train.stations[j], stop);
-            t += train.travelTimes[j];
         }
         return 0;
     }
 
     void query_train(const std::string &i, const Date &d) {
-        ustring id(i);
+        unsigned id;
+        long address;
         Train train;
-        if (released_trains.find(id, train)) { //released train find
+        if (!train_dict.find(ustring(i), id)) { //never added
+            std::cout << "-1\n";
+            return;
+        }
+        if (released_trains.find(id, address)) { //released train find
+            read_train(address, train);
             if (d < train.beginDate || d > train.endDate) {
                 std::cout << "-1\n";
                 return;
             }
-            Index index{id, d};
-            output_query_train(train, seats_map[index], d);
+            output_query_train(train, seats_map[Index(id, d)], d);
         } else {
-            if (!train_map.find(id, train)) { //no find
+            if (!train_map.find(id, address)) { //no find
                 std::cout << "-1\n";
                 return;
             }
+            read_train(address, train);
             if (d < train.beginDate || d > train.endDate) {
                 std::cout << "-1\n";
                 return;
@@ -135,15 +234,18 @@ public:
 
     void query_ticket(const std::string &s, const std::string &t, const Date &date, bool sortInTime) {
         if (s == t) sjtu::error("query_ticket chaos: from same to same");
-        sstring from(s), to(t);
+        unsigned from, to;
         vector<Stop> stop1, stop2;
-        stop_multimap.find(from, stop1); //ascending in id
-        stop_multimap.find(to, stop2);
+        if (station_dict.find(sstring(s), from) && station_dict.find(sstring(t), to)) {
+            stop_multimap.find(from, stop1); //ascending in id
+            stop_multimap.find(to, stop2);
+        }
         if (stop1.empty() || stop2.empty()) {
             std::cout << "0\n";
             return;
         }
         vector<Ticket> tickets;
+        Train train;
         auto it2 = stop2.begin();
         for (auto &tmp1: stop1) {
             while (it2 != stop2.end() && *it2 < tmp1) ++it2;
@@ -161,11 +263,11 @@ public:
             tmp2.arrive.date += dayAfterBegin;
             //tmp2.leave.date += dayAfterBegin;
             //tmp not going to be used again
-            Train train = released_trains[tmp1.id];
+            read_train(released_trains[tmp1.id], train);
             int price = train.getPrice(tmp1.index, tmp2.index - 1);
-            Seat seat = seats_map[Index{tmp1.id, startDate}];
+            Seat seat = seats_map[Index(tmp1.id, startDate)];
             int seatNum = seat.min(tmp1.index, tmp2.index - 1);
-            Ticket ticket(tmp1.id, tmp1.leave, tmp2.arrive, price, seatNum);
+            Ticket ticket(train.trainID, tmp1.leave, tmp2.arrive, price, seatNum);
             tickets.push_back(ticket);
         }
         sort(tickets, 0, tickets.size() - 1, sortInTime ? cmp_time : cmp_cost);
@@ -181,13 +283,16 @@ public:
     void buy_ticket(int timestamp, const std::string &u, const std::string &i, const Date &d, int n,
                     const std::string &f, const std::string &t, bool pend) {
         //d represent the leaving date of from
-        ustring username(u), id(i);
-        sstring from(f), to(t);
+        ustring username(u);
+        unsigned id, from, to;
+        long address;
         Train train;
-        if (!released_trains.find(id, train)) { //train no find
+        if (!station_dict.find(sstring(f), from) || !station_dict.find(sstring(t), to) ||
+            !train_dict.find(ustring(i), id) || !released_trains.find(id, address)) { //station or train no find
             std::cout << "-1\n";
             return;
         }
+        read_train(address, train);
         if (train.seat < n) { //n more than maximum seat (Accuse: why not showed clearly at the document?!)
             std::cout << "-1\n";
             return;
@@ -206,7 +311,7 @@ public:
         }
         start.date += dayAfterBegin;
         end.date += dayAfterBegin;
-        Index index = {id, startDate};
+        Index index(id, startDate);
         Seat seat = seats_map[index];
         int remainNum = seat.min(l, r - 1);
         int price = train.getPrice(l, r - 1);
@@ -227,34 +332,30 @@ public:
 
     void query_order(const std::string &u) {
         ustring user(u);
-        vector<Order> orders;
-        order_u.find(user, orders); //orders ascending
-        std::cout << orders.size() << '\n';
-        for (int i = orders.size() - 1; i >= 0; --i) std::cout << orders[i] << '\n';
+        std::cout << order_u.count(user) << '\n';
+        for (auto it = --order_u.upperBound(user); it.valid() && it.key() == user; --it) //newest first
+            output_order(it.value());
     }
 
     int refund_ticket(const std::string &u, int n) {
         ustring user(u);
+        if (n < 1) return -1;
+        auto it = --order_u.upperBound(user); //the latest order
+        for (int i = 1; i < n && it.valid() && it.key() == user; ++i) --it;
+        if (!it.valid() || it.key() != user || it.value().status == -1) return -1;
+        Order order = it.value(); //copy
         vector<Order> orders;
-        order_u.find(user, orders);
-        int i = orders.size() - n;
-        if (i < 0 || n < 1 || orders[i].status == -1) return -1;
-        Order order = orders[i]; //copy
         Index &index = order.index;
         if (order.status == 0) pending_order.erase(index, order); //refund pending order
         else { //refund success order
             Seat seat = seats_map[index];
             seat.modify(order.l, order.r - 1, order.num);
             pending_order.find(index, orders);
-            for (auto &tmp: orders) { //orders is a tmp vector in RAM
-                if (tmp.l >= order.r || tmp.r <= tmp.l) continue; //for faster
-                int remain = seat.min(tmp.l, tmp.r - 1);
-                if (remain >= tmp.num) {
-                    seat.modify(tmp.l, tmp.r - 1, -tmp.num);
-                    pending_order.erase(tmp.index, tmp);
-                    change_order_status(tmp, 1);
-                }
-            }
+            if (N - 1 >= SeatTreeLanes && orders.size() > 1) { //long routes: O(log N) for each order in the queue
+                SeatTree<N - 1> tree(seat.remain);
+                resolve_pending(tree, order, orders);
+                tree.store(seat.remain);
+            } else resolve_pending(seat, order, orders);
             seats_map.assign(index, seat);
         }
         change_order_status(order, -1);
@@ -262,24 +363,43 @@ public:
     }
 
 private:
-    my::BPT<ustring, Train> train_map; //when train released, remove it to released_train
-    my::BPT<ustring, Train> released_trains;
+    my::Dictionary<sstring> station_dict; //station names <-> ids kept by trains, stops and orders
+    my::Dictionary<ustring> train_dict; //train IDs <-> the handles every tree and record below keeps
 
-    struct Index {
-        ustring id;
-        Date date; //start date
+    my::Heap train_heap; //every train record, encoded to the stations it has (see Train::encode)
+    my::BPT<unsigned, long> train_map; //address in train_heap, when train released, remove it to released_train
+    my::BPT<unsigned, long, Scanned> released_trains;
+
+    inline long write_train(const Train &train) {
+        unsigned char buf[Train::MaxSize];
+        train.encode(buf);
+        return train_heap.add(buf, train.encodedSize());
+    }
+
+    inline void read_train(long address, Train &train) { train.decode(train_heap.peek(address)); }
+
+    struct Index { //a train handle and a start date packed in one integer
+        unsigned long long key = 0; //handle << 32 | month << 8 | day
+
+        Index() = default;
 
-        inline bool operator<(const Index &index) const { return id == index.id ? date < index.date : id < index.id; }
+        Index(unsigned id, const Date &date) : key((unsigned long long) id << 32 | date.month << 8 | date.day) {}
 
-        inline bool operator>(const Index &index) const { return id == index.id ? date > index.date : id > index.id; }
+        inline unsigned id() const { return (unsigned) (key >> 32); }
 
-        inline bool operator>=(const Index &index) const { return id == index.id ? date >= index.date : id > index.id; }
+        inline Date date() const { return {(int) (key >> 8 & 0xff), (int) (key & 0xff)}; }
 
-        inline bool operator<=(const Index &index) const { return id == index.id ? date <= index.date : id < index.id; }
+        inline bool operator<(const Index &index) const { return key < index.key; }
 
-        inline bool operator!=(const Index &index) const { return id != index.id || date != index.date; }
+        inline bool operator>(const Index &index) const { return key > index.key; }
 
-        inline bool operator==(const Index &index) const { return id == index.id && date == index.date; }
+        inline bool operator>=(const Index &index) const { return key >= index.key; }
+
+        inline bool operator<=(const Index &index) const { return key <= index.key; }
+
+        inline bool operator!=(const Index &index) const { return key != index.key; }
+
+        inline bool operator==(const Index &index) const { return key == index.key; }
     };
 
     struct Seat {
@@ -291,30 +411,26 @@ private:
             for (int i = 0; i < train.stationNum; ++i) remain[i] = train.seat;
         }
 
-        inline void modify(int l, int r, int add) {
-            for (int i = l; i <= r; ++i) remain[i] += add;
-        }
+        inline void modify(int l, int r, int add) { SeatKernel::add(remain, l, r, add); }
 
-        inline int min(int l, int r) {
-            int tmp = 1e5 + 1;
-            for (int i = l; i <= r; ++i) tmp = std::min(tmp, remain[i]);
-            return tmp;
-        }
+        inline int min(int l, int r) const { return SeatKernel::min(remain, l, r); }
     };
 
-    my::BPT<Index, Seat> seats_map; //only for train released
+    my::BPT<Index, Seat, SeatTraits> seats_map; //only for train released
 
     struct Stop {
-        ustring id;
+        unsigned id = 0; //train handle
         Date beginDate, endDate; //train start date
         int index = 0; //station = train_map[id].stations[index]
         Date_Time arrive, leave;
 
         Stop() = default;
 
-        explicit Stop(const std::string &s) : id(s) {}
+        explicit Stop(unsigned id) : id(id) {}
+
+        using sep_type = unsigned; //stops are ordered by id only, so stop_multimap separators keep just that
 
-        explicit Stop(const ustring &id) : id(id) {}
+        inline unsigned sep() const { return id; }
 
         inline bool operator<(const Stop &stop) const {
             return id < stop.id;
@@ -342,7 +458,7 @@ private:
         }
     };
 
-    my::multiBPT<sstring, Stop> stop_multimap; //store all stopping information for train released
+    my::multiBPT<unsigned, Stop, Scanned> stop_multimap; //by station id, all stopping information for train released
 
     struct Ticket {
         ustring id;
@@ -359,7 +475,7 @@ private:
         ustring username;
         Index index;
         int time = 0, status = 1, price = 0, num = 0; //status: 1-success, 0-pending, -1-refunded
-        sstring from, to;
+        unsigned from = 0, to = 0; //station ids
         int l = 0, r = 0; //index of from and right
         Date_Time start, end;
 
@@ -367,10 +483,14 @@ private:
 
         explicit Order(int time) : time(time) {}
 
-        Order(int time, int p, int n, const ustring &u, Index index, const sstring &f, const sstring &t,
-              const Date_Time &st, const Date_Time &ed, int l, int r) : time(time), num(n), price(p),
-                                                                        username(u), index(std::move(index)), from(f),
-                                                                        to(t), start(st), end(ed), l(l), r(r) {}
+        Order(int time, int p, int n, const ustring &u, Index index, unsigned f, unsigned t,
+              const Date_Time &st, const Date_Time &ed, int l, int r) : username(u), index(index), time(time),
+                                                                        price(p), num(n), from(f), to(t), l(l), r(r),
+                                                                        start(st), end(ed) {}
+
+        using sep_type = int; //orders are ordered by time only, so order trees keep just that in separators
+
+        inline int sep() const { return time; }
 
         inline bool operator<(const Order &order) const { return time < order.time; }
 
@@ -383,20 +503,24 @@ private:
         inline bool operator==(const Order &order) const { return time == order.time; }
 
         inline bool operator!=(const Order &order) const { return time != order.time; }
-
-        friend std::ostream &operator<<(std::ostream &os, const Order &order) {
-            if (order.status == 1) os << "[success] ";
-            else if (order.status == 0) os << "[pending] ";
-            else os << "[refunded] ";
-            os << order.index.id << ' ' << order.from << ' ' << order.start << " -> " << order.to
-               << ' ' << order.end << ' ' << order.price << ' ' << order.num;
-            return os;
-        }
     };
 
     my::multiBPT<Index, Order> pending_order;
     my::multiBPT<ustring, Order> order_u;
 
+    template<class Seats>
+    void resolve_pending(Seats &seat, const Order &refunded, vector<Order> &orders) { //Seat or SeatTree
+        for (auto &tmp: orders) { //orders is a tmp vector in RAM
+            if (tmp.l >= refunded.r || tmp.r <= tmp.l) continue; //for faster
+            int remain = seat.min(tmp.l, tmp.r - 1);
+            if (remain >= tmp.num) {
+                seat.modify(tmp.l, tmp.r - 1, -tmp.num);
+                pending_order.erase(tmp.index, tmp);
+                change_order_status(tmp, 1);
+            }
+        }
+    }
+
     static inline bool cmp_cost(const Ticket &a, const Ticket &b) {
         if (a.price == b.price) return a.id <= b.id;
         return a.price < b.price;
@@ -408,9 +532,11 @@ private:
         return ta < tb;
     }
 
-    static inline void output_query_train(const Train &train, const Seat &seat, const Date &date);
+    inline void output_query_train(const Train &train, const Seat &seat, const Date &date);
 
-    static inline bool search_train_info(const Train &train, const sstring &f, const sstring &t, int &l, int &r,
+    inline void output_order(const Order &order);
+
+    static inline bool search_train_info(const Train &train, unsigned f, unsigned t, int &l, int &r,
                                          Date_Time &st, Date_Time &ed);
 
     inline void change_order_status(Order &order, int status) {
@@ -420,23 +546,23 @@ private:
     }
 
     struct transferInfo {
-        Date_Time arrive;
+        int arrive = 0; //minutes after the origin of query_transfer
         int timecost = 0;
         int cost = 0;
-        ustring id;
+        unsigned id = 0; //train handle
     };
 
     struct Transfer {
-        ustring id1;
-        ustring id2;
+        unsigned id1 = 0, id2 = 0; //train handles
         int time = 0;
         int price = 0;
-        sstring common;
+        unsigned common = 0; //station id
         int wait = 0;
     };
 
-    static inline bool cmp_transfer(const Transfer &a, const Transfer &b, bool time) { //return a<b
-        if (a.time == b.time && a.price == b.price) return a.id1 == b.id1 ? a.id2 < b.id2 : a.id1 < b.id1;
+    inline bool cmp_transfer(const Transfer &a, const Transfer &b, bool time) { //return a<b
+        if (a.time == b.time && a.price == b.price) //ties are broken by train IDs, only then read back
+            return a.id1 == b.id1 ? train_dict[a.id2] < train_dict[b.id2] : train_dict[a.id1] < train_dict[b.id1];
         if (time) return a.time == b.time ? a.price < b.price : a.time < b.time;
         else return a.price == b.price ? a.time < b.time : a.price < b.price;
     }
@@ -446,59 +572,63 @@ private:
 //-------------------------------------------------------------------
 
 void TrainSystem::output_query_train(const Train &train, const TrainSystem::Seat &seat, const Date &date) {
-    int price = 0; //prices accumulate!
     std::cout << train.trainID << ' ' << train.type << '\n';
     Date_Time t = {date, train.startTime};
-    std::cout << train.stations[0] << " xx-xx xx:xx -> " << t << " 0 " << seat.remain[0] << '\n';
-    t += train.travelTimes[0];
+    std::cout << station_dict[train.stations[0]] << " xx-xx xx:xx -> " << t << " 0 " << seat.remain[0] << '\n';
     for (int j = 1; j < train.stationNum - 1; ++j) {
-        std::cout << train.stations[j] << ' ' << t << " -> ";
-        t += train.stopoverTimes[j - 1];
-        price += train.prices[j - 1];
-        std::cout << t << ' ' << price << ' ' << seat.remain[j] << '\n';
-        t += train.travelTimes[j];
+        std::cout << station_dict[train.stations[j]] << ' ' << t + train.arrive[j] << " -> " << t + train.leave[j]
+                  << ' ' << train.price[j] << ' ' << seat.remain[j] << '\n';
     }
-    //j = stationNum - 1
-    price += train.prices[train.stationNum - 2];
-    std::cout << train.stations[train.stationNum - 1] << ' ' << t << " -> xx-xx xx:xx "
-              << price << " x\n";
+    int last = train.stationNum - 1;
+    std::cout << station_dict[train.stations[last]] << ' ' << t + train.arrive[last] << " -> xx-xx xx:xx "
+              << train.price[last] << " x\n";
 }
 
-bool TrainSystem::search_train_info(const Train &train, const TrainSystem::sstring &f, const TrainSystem::sstring &t,
-                                    int &l, int &r, Date_Time &st, Date_Time &ed) {
+void TrainSystem::output_order(const TrainSystem::Order &order) {
+    if (order.status == 1) std::cout << "[success] ";
+    else if (order.status == 0) std::cout << "[pending] ";
+    else std::cout << "[refunded] ";
+    std::cout << train_dict[order.index.id()] << ' ' << station_dict[order.from] << ' ' << order.start << " -> "
+              << station_dict[order.to] << ' ' << order.end << ' ' << order.price << ' ' << order.num << '\n';
+}
+
+bool TrainSystem::search_train_info(const Train &train, unsigned f, unsigned t, int &l, int &r,
+                                    Date_Time &st, Date_Time &ed) {
     //we search the first day train here
-    Date_Time now = {train.beginDate, train.startTime}; //leave
+    Date_Time start = {train.beginDate, train.startTime};
     bool findl = false;
     for (int i = 0; i < train.stationNum; ++i) {
         if (train.stations[i] == t) {
             if (!findl) return false;
             r = i;
-            ed = now;
+            ed = start + train.arrive[i];
             return true;
         }
-        if (i && i < train.stationNum - 1) now += train.stopoverTimes[i - 1]; //leave
         if (train.stations[i] == f) { //it's for station from where we need to wait for stopping
             if (findl) sjtu::error("search train information chaos");
             l = i;
-            st = now;
+            st = start + train.leave[i];
             findl = true;
         }
-        if (i < train.stationNum - 1) now += train.travelTimes[i]; //arrive
     }
     return false;
 }
 
 void TrainSystem::query_transfer(const std::string &s, const std::string &t, const Date &date, bool sortInTime) {
     if (s == t) sjtu::error("query_transfer chaos: from same to same");
-    sstring from(s), to(t);
+    unsigned from, to;
     vector<Stop> stops1, stops2;
-    stop_multimap.find(from, stops1); //ascending in {id,startDate}
-    stop_multimap.find(to, stops2);
+    if (station_dict.find(sstring(s), from) && station_dict.find(sstring(t), to)) {
+        stop_multimap.find(from, stops1); //ascending in {id,startDate}
+        stop_multimap.find(to, stops2);
+    }
     if (stops1.empty() || stops2.empty()) {
         std::cout << "0\n";
         return;
     }
     TransferMap<transferInfo> hashmap_station;
+    const Date_Time origin{}; //times below are in minutes after it
+    Train train;
     for (auto &stop: stops1) {
         //if (stop.leave.date != date) continue;
 
@@ -508,38 +638,31 @@ void TrainSystem::query_transfer(const std::string &s, const std::string &t, con
         stop.arrive.date += dayAfterBegin;
         stop.leave.date += dayAfterBegin;
 
-        Train train = released_trains[stop.id];
-        int price = 0;
-        int timecost = 0;
-        Date_Time leave = stop.leave;
-        for (int i = stop.index + 1; i < train.stationNum; ++i) { //i-1 -> i
-            price += train.prices[i - 1];
-            timecost += train.travelTimes[i - 1]; //arrive
-            hashmap_station.insert(train.stations[i].hash(), transferInfo{leave + timecost, timecost, price, stop.id});
-            timecost += train.stopoverTimes[i - 1];
+        read_train(released_trains[stop.id], train);
+        int leave = stop.leave - origin, l = stop.index;
+        for (int i = l + 1; i < train.stationNum; ++i) { //l -> i
+            int timecost = train.arrive[i] - train.leave[l];
+            hashmap_station.insert((int) train.stations[i], transferInfo{leave + timecost, timecost,
+                                                                         train.price[i] - train.price[l], stop.id});
         }
     }
     Transfer *best = nullptr, tmp;
-    Train train;
-    ustring lastID; //prevent repeated BPT search
+    unsigned lastID = -1; //no train read yet, prevent repeated BPT search
     for (auto &stop: stops2) {
         int tot = stop.endDate - stop.beginDate;
         for (int j = 0; j <= tot; ++j, ++stop.arrive.date, ++stop.leave.date) {
             if (stop.arrive.date < date) continue;
             if (stop.id != lastID) { //new id
-                train = released_trains[stop.id];
+                read_train(released_trains[stop.id], train);
                 lastID = stop.id;
             }
-            int price = 0;
-            int timecost = 0;
-            Date_Time leave = stop.arrive;
-            for (int i = stop.index - 1; i >= 0; --i) { //i -> i+1
-                price += train.prices[i];
-                timecost += train.travelTimes[i];
-                leave -= train.travelTimes[i]; //leaving time of station[i]
-                // processing
-                if (hashmap_station.has(train.stations[i].hash())) {
-                    auto p = hashmap_station.query(train.stations[i].hash());
+            int arrive = stop.arrive - origin, r = stop.index;
+            for (int i = r - 1; i >= 0; --i) { //i -> r
+                int price = train.price[r] - train.price[i];
+                int timecost = train.arrive[r] - train.leave[i];
+                int leave = arrive - timecost; //leaving time of station[i]
+                if (hashmap_station.has((int) train.stations[i])) { //indexed by station id
+                    auto p = hashmap_station.query((int) train.stations[i]);
                     for (const auto &info: *p) {
                         int waitTime = leave - info.arrive;
                         if (waitTime < 0) continue;
@@ -551,11 +674,6 @@ void TrainSystem::query_transfer(const std::string &s, const std::string &t, con
                             *best = tmp; //update
                     }
                 }
-                if (i) {
-                    timecost += train.stopoverTimes[i - 1];
-                    leave -= train.stopoverTimes[i - 1]; //arriving time of station[i]
-                    //stopoverTime[i] represent stop time in i+1 and i+2
-                }
             }
         }
 
@@ -566,10 +684,11 @@ void TrainSystem::query_transfer(const std::string &s, const std::string &t, con
     }
     //now we got best transfer
     //read train1 & train2
-    Train train1 = released_trains[best->id1];
-    Train train2 = released_trains[best->id2];
+    Train train1, train2;
+    read_train(released_trains[best->id1], train1);
+    read_train(released_trains[best->id2], train2);
     //search_train_info with from & to & common
-    int l1, l2, r1, r2;
+    int l1 = -1, l2 = -1, r1 = -1, r2 = -1;
     Date_Time st1, st2, ed1, ed2;
     search_train_info(train1, from, best->common, l1, r1, st1, ed1);
     search_train_info(train2, best->common, to, l2, r2, st2, ed2);
@@ -582,9 +701,9 @@ void TrainSystem::query_transfer(const std::string &s, const std::string &t, con
     if (startDate < train1.beginDate || startDate > train1.endDate) {
         sjtu::error("query_transfer chaos1: best transfer found but wrong");
     } //safety check
-    Seat seat = seats_map[Index{best->id1, startDate}];
+    Seat seat = seats_map[Index(best->id1, startDate)];
     int seatNum = seat.min(l1, r1 - 1);
-    std::cout << best->id1 << ' ' << s << ' ' << st1 << " -> " << best->common << ' '
+    std::cout << train1.trainID << ' ' << s << ' ' << st1 << " -> " << station_dict[best->common] << ' '
               << ed1 << ' ' << price << ' ' << seatNum << '\n';
     //output train2
     price = train2.getPrice(l2, r2 - 1);
@@ -595,9 +714,9 @@ void TrainSystem::query_transfer(const std::string &s, const std::string &t, con
     if (startDate < train2.beginDate || startDate > train2.endDate) {
         sjtu::error("query_transfer chaos2: best transfer found but wrong");
     } //safety check
-    seat = seats_map[Index{best->id2, startDate}];
+    seat = seats_map[Index(best->id2, startDate)];
     seatNum = seat.min(l2, r2 - 1);
-    std::cout << best->id2 << ' ' << best->common << ' ' << st2 << " -> " << t << ' '
+    std::cout << train2.trainID << ' ' << station_dict[best->common] << ' ' << st2 << " -> " << t << ' '
               << ed2 << ' ' << price << ' ' << seatNum << '\n';
     delete best;
 }
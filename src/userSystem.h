@@ -115,6 +115,15 @@ public:
         user_map.clear();
     }
 
+    void pinInternal(size_t pages) { user_map.pinInternal(pages); } //pages per tree
+
+    void flush() { user_map.flush(); }
+
+    void reload() { //after restoring a snapshot, nobody is logged in
+        user_login.clear();
+        user_map.reload();
+    }
+
     inline bool logged_in(const std::string &u) const { return user_login.count(ustring(u)); }
 
 private:
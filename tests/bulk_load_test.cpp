@@ -0,0 +1,220 @@
+#include <cstdio>
+#include <map>
+#include <set>
+#include <random>
+#include "test.h"
+#include "BPT.h"
+#include "multi_BPT.h"
+#include "myString.h"
+
+/*
+ * BPT::bulkLoad and multiBPT::bulkLoad against std::map / std::set, with keys of both
+ * kinds a node can keep (see key.h): stored unchanged, a plain integer or a struct, and encoded.
+ * After the load, and again after reopening the files, find(), count(), size() and
+ * cursors in both directions must see exactly the loaded data, and later writes still work.
+ */
+
+struct Title { //no encode(): nodes keep it unchanged and compare with its own operators
+    char s[24]{};
+
+    Title() = default;
+
+    explicit Title(int x) { snprintf(s, sizeof(s), "title-%08d", x); }
+
+    bool operator<(const Title &t) const { return strcmp(s, t.s) < 0; }
+
+    bool operator>(const Title &t) const { return strcmp(s, t.s) > 0; }
+
+    bool operator<=(const Title &t) const { return strcmp(s, t.s) <= 0; }
+
+    bool operator>=(const Title &t) const { return strcmp(s, t.s) >= 0; }
+
+    bool operator==(const Title &t) const { return strcmp(s, t.s) == 0; }
+
+    bool operator!=(const Title &t) const { return strcmp(s, t.s) != 0; }
+};
+
+static_assert(std::is_same<my::stored_key<int>, int>::value, "int is stored unchanged");
+static_assert(std::is_same<my::stored_key<my::string<20>>, my::EncodedKey<my::string<20>>>::value, "encoded");
+static_assert(std::is_same<my::stored_key<Title>, Title>::value, "Title is stored unchanged");
+
+template<class K>
+K makeKey(int x); //ascending in x
+
+template<>
+int makeKey<int>(int x) { return x; }
+
+template<>
+my::string<20> makeKey<my::string<20>>(int x) {
+    char b[24];
+    snprintf(b, sizeof(b), "k%08d", x);
+    return my::string<20>(b);
+}
+
+template<>
+Title makeKey<Title>(int x) { return Title(x); }
+
+struct Big { //too large for a leaf, kept in the data file
+    int x = 0;
+    char pad[600]{};
+};
+
+inline int valueOf(int v) { return v; }
+
+inline int valueOf(const Big &v) { return v.x; }
+
+template<class T>
+T makeValue(int x);
+
+template<>
+int makeValue<int>(int x) { return x; }
+
+template<>
+Big makeValue<Big>(int x) {
+    Big b;
+    b.x = x;
+    return b;
+}
+
+template<class K, class T>
+void checkMap(my::BPT<K, T> &map, const std::map<int, int> &ref, int range) {
+    CHECK(map.size() == ref.size());
+    for (int x = 0; x < range; ++x) {
+        T v;
+        auto it = ref.find(x);
+        CHECK(map.find(makeKey<K>(x), v) == (it != ref.end()));
+        if (it != ref.end()) CHECK(valueOf(v) == it->second);
+    }
+    auto it = map.begin();
+    for (auto &p: ref) {
+        CHECK(it.valid());
+        CHECK(it.key() == makeKey<K>(p.first));
+        CHECK(valueOf(it.value()) == p.second);
+        ++it;
+    }
+    CHECK(!it.valid());
+    auto rt = --map.end();
+    for (auto p = ref.rbegin(); p != ref.rend(); ++p, --rt) {
+        CHECK(rt.valid());
+        CHECK(rt.key() == makeKey<K>(p->first));
+    }
+    CHECK(!rt.valid());
+}
+
+template<class K, class T>
+void testMap(double fill, int n) {
+    freshDir();
+    std::mt19937 rng(n);
+    std::map<int, int> ref;
+    int range = n * 3;
+    for (int i = 0; i < n; ++i) ref[(int) (rng() % range)] = (int) rng();
+    {
+        my::BPT<K, T> map("map");
+        auto it = ref.begin();
+        bool repeated = false;
+        map.bulkLoad([&](K &k, T &v) {
+            if (it == ref.end()) return false;
+            k = makeKey<K>(it->first);
+            if (!repeated) { //the first key twice: the later value wins
+                v = makeValue<T>(-1);
+                repeated = true;
+                return true;
+            }
+            v = makeValue<T>(it->second);
+            ++it;
+            return true;
+        }, fill);
+        checkMap(map, ref, range);
+    }
+    my::BPT<K, T> map("map");
+    checkMap(map, ref, range);
+    for (int i = 0; i < n; ++i) { //the loaded tree must take ordinary writes
+        int x = (int) (rng() % range);
+        if (rng() % 2) {
+            map.assign(makeKey<K>(x), makeValue<T>(i));
+            ref[x] = i;
+        } else CHECK(map.erase(makeKey<K>(x)) == (ref.erase(x) > 0));
+    }
+    checkMap(map, ref, range);
+    std::filesystem::current_path("..");
+}
+
+template<class K>
+void checkMulti(my::multiBPT<K, int> &map, const std::set<std::pair<int, int>> &ref, int range) {
+    CHECK(map.size() == ref.size());
+    for (int x = 0; x < range; ++x) {
+        sjtu::vector<int> out;
+        map.find(makeKey<K>(x), out);
+        size_t c = 0;
+        for (auto p = ref.lower_bound({x, INT32_MIN}); p != ref.end() && p->first == x; ++p, ++c) {
+            CHECK(c < out.size());
+            CHECK(out[c] == p->second);
+        }
+        CHECK(c == out.size());
+        CHECK(map.count(makeKey<K>(x)) == c);
+    }
+    auto it = map.begin();
+    for (auto &p: ref) {
+        CHECK(it.valid());
+        CHECK(it.key() == makeKey<K>(p.first));
+        CHECK(it.value() == p.second);
+        ++it;
+    }
+    CHECK(!it.valid());
+    auto rt = --map.end();
+    for (auto p = ref.rbegin(); p != ref.rend(); ++p, --rt) {
+        CHECK(rt.valid());
+        CHECK(rt.value() == p->second);
+    }
+    CHECK(!rt.valid());
+}
+
+template<class K>
+void testMulti(double fill, int n) {
+    freshDir();
+    std::mt19937 rng(n + 1);
+    std::set<std::pair<int, int>> ref;
+    int range = n / 4 + 1;
+    for (int i = 0; i < n; ++i) ref.insert({(int) (rng() % range), (int) (rng() % 1000)});
+    {
+        my::multiBPT<K, int> map("multi");
+        auto it = ref.begin();
+        bool repeated = false;
+        map.bulkLoad([&](K &k, int &v) {
+            if (it == ref.end()) return false;
+            k = makeKey<K>(it->first), v = it->second;
+            if (!repeated) repeated = true; //the first element twice: kept once
+            else ++it;
+            return true;
+        }, fill);
+        checkMulti(map, ref, range);
+    }
+    my::multiBPT<K, int> map("multi");
+    checkMulti(map, ref, range);
+    for (int i = 0; i < n; ++i) {
+        int x = (int) (rng() % range), v = (int) (rng() % 1000);
+        if (rng() % 2) {
+            map.insert(makeKey<K>(x), v);
+            ref.insert({x, v});
+        } else CHECK(map.erase(makeKey<K>(x), v) == (ref.erase({x, v}) > 0));
+    }
+    checkMulti(map, ref, range);
+    std::filesystem::current_path("..");
+}
+
+int main() {
+    for (double fill: {0.6, 1.0}) {
+        for (int n: {1, 500, 20000}) {
+            testMap<int, int>(fill, n);
+            testMap<my::string<20>, int>(fill, n);
+            testMap<Title, int>(fill, n);
+            testMulti<int>(fill, n);
+            testMulti<my::string<20>>(fill, n);
+            testMulti<Title>(fill, n);
+        }
+        testMap<int, Big>(fill, 5000);
+        testMap<Title, Big>(fill, 5000);
+    }
+    std::cout << "bulk load ok\n";
+    return 0;
+}
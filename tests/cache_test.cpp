@@ -0,0 +1,170 @@
+#include <random>
+#include "test.h"
+#include "cache.h"
+
+/*
+ * Cache and BufferPool (cache.h) on a file of tagged 4 KiB pages, with a pool of 16 pages.
+ * Whether a page is still cached is seen from outside: the test changes the file under the
+ * cache, and a cached page still reads as it was.
+ */
+
+struct Page {
+    long tag = 0;
+    char pad[4096 - sizeof(long)]{};
+};
+
+constexpr long PageSize = sizeof(Page), Pages = 400;
+constexpr size_t Budget = 16;
+
+long tagOf(long page) { return page * 1000 + 7; }
+
+void writeFile(const char *name) { //page i tagged tagOf(i)
+    my::PreadBackend file(name);
+    for (long i = 0; i < Pages; ++i) {
+        Page p;
+        p.tag = tagOf(i);
+        file.write(i * PageSize, &p, sizeof(Page));
+    }
+}
+
+long fileTag(const char *name, long page) {
+    long tag = 0;
+    my::PreadBackend(name).read(page * PageSize, &tag, sizeof(long));
+    return tag;
+}
+
+void setFileTag(const char *name, long page, long tag) { my::PreadBackend(name).write(page * PageSize, &tag, sizeof(long)); }
+
+long cachedTag(Cache<Page> &cache, long page) {
+    Page p;
+    cache.read(page * PageSize, p);
+    return p.tag;
+}
+
+void sharedBudget() { //two caches, one budget, victims picked across both
+    BufferPool &pool = BufferPool::instance();
+    writeFile("a");
+    writeFile("b");
+    my::Storage fa("a"), fb("b");
+    Cache<Page> a, b;
+    a.init(fa);
+    b.init(fb);
+    for (long i = 0; i < 8; ++i) CHECK(cachedTag(a, i) == tagOf(i));
+    for (long i = 0; i < 8; ++i) CHECK(a.has(i * PageSize));
+    std::mt19937 rng(1);
+    for (int i = 0; i < 2000; ++i) {
+        long page = (long) (rng() % Pages);
+        CHECK(cachedTag(rng() % 4 ? b : a, page) == tagOf(page));
+        CHECK(pool.usedBytes() <= Budget * PageSize);
+    }
+    for (long i = 100; i < 100 + (long) Budget; ++i) cachedTag(b, i); //the whole pool for b
+    for (long i = 0; i < 8; ++i) CHECK(!a.has(i * PageSize));
+    pool.setBudget(4); //shrinking evicts at once
+    CHECK(pool.usedBytes() <= 4 * PageSize);
+    pool.setBudget(Budget);
+}
+
+void scan(Cache<Page> &cache, long from) { //enough one-shot reads to cycle the whole pool
+    for (long i = from; i < from + 3 * (long) Budget; ++i) cachedTag(cache, i);
+}
+
+void dirtyWriteBack() { //only modified frames reach the file, at eviction or flush
+    writeFile("c");
+    my::Storage file("c");
+    Cache<Page> cache;
+    cache.init(file);
+    cache[0].tag = 111; //operator[] marks the frame dirty
+    CHECK(fileTag("c", 0) == tagOf(0)); //not written through
+    cache.flush();
+    CHECK(fileTag("c", 0) == 111);
+
+    CHECK(cachedTag(cache, 5) == tagOf(5)); //clean frames, read() and peek()
+    CHECK(cache.peek(6 * PageSize).tag == tagOf(6));
+    setFileTag("c", 5, -5);
+    setFileTag("c", 6, -6);
+    cache.flush();
+    CHECK(fileTag("c", 5) == -5 && fileTag("c", 6) == -6);
+    scan(cache, 100);
+    CHECK(fileTag("c", 5) == -5 && fileTag("c", 6) == -6); //evicted without a write
+    CHECK(cachedTag(cache, 5) == -5);
+
+    cache[9 * PageSize].tag = 999;
+    cache.flush(); //clean again: a later eviction writes nothing
+    setFileTag("c", 9, -9);
+    scan(cache, 200);
+    CHECK(fileTag("c", 9) == -9);
+
+    cache[10 * PageSize].tag = 1010;
+    scan(cache, 300); //a dirty victim is written back
+    CHECK(fileTag("c", 10) == 1010);
+
+    Page p;
+    p.tag = 4242;
+    cache.put(Pages * PageSize, p); //new page past the end, nothing read
+    CHECK(cachedTag(cache, Pages) == 4242);
+    cache.flush();
+    CHECK(fileTag("c", Pages) == 4242);
+}
+
+long hotAfterScan(CachePolicy policy, const char *name, long pinned = 0) { //hot pages 1 ~ 4 still cached after long scans
+    writeFile(name);
+    my::Storage file(name);
+    Cache<Page> cache;
+    cache.init(file, policy);
+    cache.setPinBudget(pinned); //pinned frames leave the probation share of the pool as it was
+    for (long i = Pages - pinned; i < Pages; ++i) {
+        cachedTag(cache, i);
+        cache.pin(i * PageSize, true);
+    }
+    for (int round = 0; round < 2; ++round) { //2Q: seen again after leaving probation, so protected
+        for (long i = 1; i <= 4; ++i) CHECK(cachedTag(cache, i) == tagOf(i));
+        scan(cache, 10 + round * 50); //pages never seen before: they stay on probation
+    }
+    for (long i = 1; i <= 4; ++i) CHECK(cachedTag(cache, i) == tagOf(i));
+    scan(cache, 150);
+    scan(cache, 250);
+    long cached = 0;
+    for (long i = 1; i <= 4; ++i) {
+        setFileTag(name, i, -i);
+        if (cachedTag(cache, i) == tagOf(i)) ++cached; //the old tag: never reread
+    }
+    return cached;
+}
+
+void pinnedFrames() { //pinned frames stay whatever the scans do, and do not count against the pool
+    BufferPool &pool = BufferPool::instance();
+    writeFile("pin");
+    my::Storage file("pin");
+    Cache<Page> cache;
+    cache.init(file);
+    cache.setPinBudget(2);
+    for (long i = 1; i <= 3; ++i) {
+        cachedTag(cache, i);
+        cache.pin(i * PageSize, true); //the third one is beyond the budget and stays in the pool
+    }
+    cache[2 * PageSize].tag = 222; //a pinned frame can still be dirty
+    scan(cache, 100);
+    CHECK(pool.usedBytes() <= Budget * PageSize);
+    CHECK(cache.has(PageSize) && cache.has(2 * PageSize) && !cache.has(3 * PageSize));
+    cache.flush();
+    CHECK(fileTag("pin", 2) == 222);
+    cache.pin(PageSize, false); //back in the pool, evicted like any other frame
+    scan(cache, 200);
+    CHECK(!cache.has(PageSize) && cache.has(2 * PageSize));
+    cache.setPinBudget(0); //unpins the rest
+    scan(cache, 300);
+    CHECK(!cache.has(2 * PageSize));
+}
+
+int main() {
+    freshDir();
+    BufferPool::instance().setBudget(Budget);
+    sharedBudget();
+    dirtyWriteBack();
+    CHECK(hotAfterScan(CachePolicy::TwoQ, "twoq") == 4);
+    CHECK(hotAfterScan(CachePolicy::LRU, "lru") == 0);
+    CHECK(hotAfterScan(CachePolicy::TwoQ, "twoqPinned", 3 * Budget) == 4);
+    pinnedFrames();
+    std::cout << "cache ok\n";
+    return 0;
+}
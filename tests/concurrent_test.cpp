@@ -0,0 +1,84 @@
+#include <atomic>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <vector>
+#include "test.h"
+#include "BPT.h"
+#include "multi_BPT.h"
+
+/*
+ * Optimistic lock coupling (latch.h), built with TICKET_CONCURRENT=1: one writer inserts
+ * shuffled keys, so nodes split all over the tree, while readers look up keys the writer
+ * has already committed. A committed key must always be found, with its own value.
+ * Keys whose insertion is still running are published only after insert/assign returns.
+ */
+
+static_assert(my::concurrent, "build with TICKET_CONCURRENT=1");
+
+struct Big { //kept in the data file, not in the leaf
+    long x = 0;
+    char pad[500]{};
+    long y = 0;
+};
+
+constexpr int Keys = 300000, Readers = 6;
+
+int main() {
+    freshDir();
+    std::vector<int> keys(Keys);
+    for (int i = 0; i < Keys; ++i) keys[i] = i;
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(12));
+
+    my::BPT<int, long> map("map");
+    my::BPT<int, Big> big("big");
+    my::multiBPT<int, int> multi("multi");
+    std::atomic<int> committed{0}, bigCommitted{0};
+    std::atomic<bool> stop{false};
+    std::atomic<long> misses{0}, lookups{0};
+
+    std::thread writer([&] {
+        for (int i = 0; i < Keys; ++i) {
+            int k = keys[i];
+            map.assign(k, (long) k * 7);
+            multi.insert(k / 2, k);
+            if (i % 8 == 0) {
+                Big b;
+                b.x = b.y = k;
+                big.assign(k, b);
+                bigCommitted.store(i / 8 + 1);
+            }
+            committed.store(i + 1);
+        }
+        stop = true;
+    });
+    std::vector<std::thread> readers;
+    for (int t = 0; t < Readers; ++t)
+        readers.emplace_back([&, t] {
+            std::mt19937 rng(100 + t);
+            while (!stop) {
+                int n = committed.load(), nb = bigCommitted.load();
+                if (!n) continue;
+                int k = keys[rng() % n];
+                long v = -1;
+                if (!map.find(k, v) || v != (long) k * 7) ++misses;
+                if (!multi.count(k / 2)) ++misses;
+                if (nb) {
+                    int kb = keys[(rng() % nb) * 8];
+                    Big b;
+                    if (!big.find(kb, b) || b.x != kb || b.y != kb) ++misses;
+                }
+                ++lookups;
+            }
+        });
+    writer.join();
+    for (auto &r: readers) r.join();
+
+    std::cout << lookups.load() << " lookups, " << misses.load() << " misses\n";
+    CHECK(misses.load() == 0);
+    CHECK(lookups.load() > 0);
+    CHECK(map.size() == (size_t) Keys);
+    CHECK(multi.size() == (size_t) Keys);
+    for (int k = 0; k < Keys; ++k) CHECK(map[k] == (long) k * 7);
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <cstdio>
+#include <vector>
+#include "test.h"
+#include "dictionary.h"
+#include "myString.h"
+
+/*
+ * my::Dictionary (dictionary.h): ids are dense and handed out in order of first use,
+ * intern() of a known name returns its id again, and after the dictionary is closed and
+ * reopened every name keeps its id and new names continue where the old ones stopped.
+ * The buffer pool is kept small so names are read back from the file, not the cache.
+ */
+
+using Name = my::string<30>;
+using Dict = my::Dictionary<Name>;
+
+Name nameOf(int x) {
+    char b[32];
+    snprintf(b, sizeof(b), "station-%d", x * 7919 % 100003); //not in id order
+    return Name(b);
+}
+
+void expect(Dict &dict, int n) { //names 0 ~ n - 1 were interned, in order
+    CHECK(dict.size() == (size_t) n);
+    for (int x = 0; x < n; ++x) {
+        unsigned id = 12345;
+        CHECK(dict.find(nameOf(x), id));
+        CHECK(id == (unsigned) x);
+        CHECK(dict[id] == nameOf(x));
+    }
+    unsigned id = 12345;
+    CHECK(!dict.find(nameOf(n), id));
+    CHECK(id == 12345); //unchanged on a miss
+}
+
+int main() {
+    BufferPool::instance().setBudget(8);
+    freshDir();
+    const int Rounds = 4, PerRound = 3000;
+    for (int round = 0; round < Rounds; ++round) {
+        Dict dict("dict");
+        expect(dict, round * PerRound);
+        for (int x = round * PerRound; x < (round + 1) * PerRound; ++x) {
+            CHECK(dict.intern(nameOf(x)) == (unsigned) x);
+            CHECK(dict.intern(nameOf(x / 2)) == (unsigned) (x / 2)); //already there
+        }
+        expect(dict, (round + 1) * PerRound);
+        if (round % 2) dict.flush(); //closing without a flush must keep them as well
+    }
+    {
+        Dict dict("dict");
+        expect(dict, Rounds * PerRound);
+        dict.clear();
+        CHECK(dict.size() == 0);
+        CHECK(dict.intern(nameOf(5)) == 0); //ids start over
+    }
+    Dict dict("dict");
+    CHECK(dict.size() == 1);
+    CHECK(dict[0] == nameOf(5));
+    std::cout << "dictionary ok\n";
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include <map>
+#include <random>
+#include <string>
+#include "test.h"
+#include "heap.h"
+
+/*
+ * my::Heap (heap.h) against a map from address to bytes, with records of every size class
+ * up to Heap::MaxRecord and a buffer pool small enough that pages are evicted all the time.
+ * Records must read back unchanged, never straddle a page, and freed space must be taken
+ * again by records of the same size class, also after the heap is closed and reopened.
+ */
+
+using Heap = my::Heap;
+using Records = std::map<long, std::string>;
+
+constexpr size_t Granule = Heap::Granule;
+
+inline size_t sizeClass(size_t len) { return (len + sizeof(unsigned short) + Granule - 1) / Granule; }
+
+std::string makeRecord(std::mt19937 &rng, size_t len) {
+    std::string s(len, '\0');
+    for (auto &c: s) c = (char) rng();
+    return s;
+}
+
+size_t randomLength(std::mt19937 &rng) { //mostly small, now and then up to a full page
+    switch (rng() % 4) {
+        case 0: return rng() % 40;
+        case 1: return rng() % 300;
+        case 2: return rng() % 1500;
+        default: return Heap::MaxRecord - rng() % 64;
+    }
+}
+
+long add(Heap &heap, Records &ref, const std::string &s) {
+    long address = heap.add(s.data(), s.size());
+    CHECK(address >= Heap::PageSize); //page 0 is the header
+    CHECK(address % Heap::PageSize + (long) (sizeClass(s.size()) * Granule) <= Heap::PageSize);
+    CHECK(!ref.count(address));
+    ref[address] = s;
+    return address;
+}
+
+void expect(Heap &heap, const Records &ref) {
+    for (auto &p: ref) {
+        CHECK(heap.length(p.first) == p.second.size());
+        CHECK(memcmp(heap.peek(p.first), p.second.data(), p.second.size()) == 0);
+    }
+    for (auto p = ref.begin(); p != ref.end(); ++p) { //no two records share a byte
+        auto q = std::next(p);
+        if (q != ref.end()) CHECK(p->first + (long) (sizeClass(p->second.size()) * Granule) <= q->first);
+    }
+}
+
+void sizeClassesAndPages() {
+    freshDir();
+    std::mt19937 rng(1);
+    Records ref;
+    Heap heap("heap");
+    for (size_t len: {(size_t) 0, (size_t) 1, (size_t) 13, (size_t) 14, (size_t) 15, Heap::MaxRecord - 1, Heap::MaxRecord})
+        add(heap, ref, makeRecord(rng, len));
+    for (size_t len = 0; len <= Heap::MaxRecord; len += 7) add(heap, ref, makeRecord(rng, len));
+    expect(heap, ref);
+    bool thrown = false;
+    try {
+        std::string s(Heap::MaxRecord + 1, 'x');
+        heap.add(s.data(), s.size());
+    } catch (...) { thrown = true; }
+    CHECK(thrown);
+    std::filesystem::current_path("..");
+}
+
+void freedSpaceIsReused() {
+    freshDir();
+    std::mt19937 rng(2);
+    Records ref;
+    {
+        Heap heap("heap");
+        for (int i = 0; i < 3000; ++i) add(heap, ref, makeRecord(rng, randomLength(rng)));
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < 400; ++i) { //free a record, the next one of its class lands on it
+                auto p = ref.begin();
+                std::advance(p, rng() % ref.size());
+                long address = p->first;
+                size_t len = p->second.size();
+                heap.del(address);
+                ref.erase(p);
+                size_t room = sizeClass(len) * Granule - sizeof(unsigned short); //longest record of the class
+                std::string s = makeRecord(rng, room - std::min<size_t>(rng() % Granule, room));
+                CHECK(add(heap, ref, s) == address);
+            }
+            expect(heap, ref);
+        }
+        heap.flush();
+    }
+    long size = my::PreadBackend("heap").size();
+    {
+        Heap heap("heap"); //the free lists come back with the header
+        expect(heap, ref);
+        std::vector<size_t> lengths;
+        for (auto &p: ref) {
+            lengths.push_back(p.second.size());
+            heap.del(p.first);
+        }
+        ref.clear();
+        for (size_t len: lengths) add(heap, ref, makeRecord(rng, len)); //the same classes again: nothing new
+        expect(heap, ref);
+    }
+    CHECK(my::PreadBackend("heap").size() == size);
+    Heap heap("heap");
+    expect(heap, ref);
+    std::filesystem::current_path("..");
+}
+
+void randomWorkload() {
+    freshDir();
+    std::mt19937 rng(3);
+    Records ref;
+    for (int reopen = 0; reopen < 4; ++reopen) {
+        Heap heap("heap");
+        expect(heap, ref);
+        for (int i = 0; i < 6000; ++i) {
+            if (!ref.empty() && rng() % 5 < 2) {
+                auto p = ref.begin();
+                std::advance(p, rng() % ref.size());
+                heap.del(p->first);
+                ref.erase(p);
+            } else add(heap, ref, makeRecord(rng, randomLength(rng)));
+        }
+        expect(heap, ref);
+        if (reopen == 2) heap.clear(), ref.clear();
+    }
+    std::filesystem::current_path("..");
+}
+
+int main() {
+    BufferPool::instance().setBudget(16); //pages go back to the file all the time
+    sizeClassesAndPages();
+    freedSpaceIsReused();
+    randomWorkload();
+    std::cout << "heap ok\n";
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <climits>
+#include <random>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "key.h"
+#include "myString.h"
+
+/*
+ * The key forms nodes keep (key.h): every comparison of two stored keys must agree
+ * with the same comparison of the keys themselves, for all six operators, and an
+ * encoded key must decode to the key it was made from.
+ * Keys are drawn so that ties in the first bytes are common, which is where an encoding
+ * could go wrong; keys without one are stored unchanged.
+ */
+
+struct Visit { //a composite key laid out from its most significant field
+    my::string<8> place;
+    int day = 0;
+
+    constexpr static size_t EncodedSize = 8 + 4;
+
+    void encode(unsigned char *out) const {
+        place.encode(out);
+        my::encodeInt(day, out + 8);
+    }
+
+    static Visit decode(const unsigned char *in) {
+        Visit v;
+        v.place = my::string<8>::decode(in);
+        v.day = my::decodeInt(in + 8);
+        return v;
+    }
+
+    bool operator<(const Visit &v) const { return place != v.place ? place < v.place : day < v.day; }
+
+    bool operator>(const Visit &v) const { return v < *this; }
+
+    bool operator<=(const Visit &v) const { return !(v < *this); }
+
+    bool operator>=(const Visit &v) const { return !(*this < v); }
+
+    bool operator==(const Visit &v) const { return place == v.place && day == v.day; }
+
+    bool operator!=(const Visit &v) const { return !(*this == v); }
+};
+
+template<class S, class K>
+void sameOrder(const S &a, const S &b, const K &x, const K &y) { //a, b stored forms of x, y
+    CHECK((a < b) == (x < y));
+    CHECK((a > b) == (x > y));
+    CHECK((a <= b) == (x <= y));
+    CHECK((a >= b) == (x >= y));
+    CHECK((a == b) == (x == y));
+    CHECK((a != b) == (x != y));
+}
+
+std::string randomText(std::mt19937 &rng, size_t maxLen) { //few letters, so long common prefixes
+    static const char *pieces[] = {"a", "b", "ab", "\xe4\xb8\x8a", "\xe6\xb5\xb7", "z", "\x7f", "0"};
+    std::string s;
+    size_t len = rng() % (maxLen + 1);
+    while (s.size() < len) s += pieces[rng() % 8];
+    if (s.size() > maxLen) s.resize(maxLen);
+    return s;
+}
+
+static_assert(std::is_same<my::stored_key<unsigned long long>, unsigned long long>::value, "stored unchanged");
+
+void encodedInts() {
+    std::mt19937 rng(2);
+    std::vector<int> xs = {INT_MIN, INT_MIN + 1, -256, -255, -1, 0, 1, 255, 256, INT_MAX - 1, INT_MAX};
+    for (int i = 0; i < 300; ++i) xs.push_back((int) rng() >> (rng() % 32));
+    for (int x: xs) {
+        unsigned char a[4];
+        my::encodeInt(x, a);
+        CHECK(my::decodeInt(a) == x);
+        for (int y: xs) {
+            unsigned char b[4];
+            my::encodeInt(y, b);
+            int c = memcmp(a, b, 4);
+            CHECK((c < 0) == (x < y) && (c == 0) == (x == y));
+        }
+    }
+}
+
+void encodedStrings() {
+    using S = my::string<12>;
+    static_assert(std::is_same<my::stored_key<S>, my::EncodedKey<S>>::value, "encoded");
+    std::mt19937 rng(3);
+    std::vector<S> keys;
+    for (int i = 0; i < 400; ++i) keys.emplace_back(randomText(rng, 12)); //up to the full width, no terminator
+    for (auto &x: keys) {
+        my::EncodedKey<S> a(x);
+        CHECK((S) a == x);
+        for (auto &y: keys) sameOrder(a, my::EncodedKey<S>(y), x, y);
+    }
+}
+
+void encodedComposites() {
+    static_assert(std::is_same<my::stored_key<Visit>, my::EncodedKey<Visit>>::value, "encoded");
+    std::mt19937 rng(4);
+    std::vector<Visit> keys(300);
+    for (auto &v: keys) {
+        v.place = my::string<8>(randomText(rng, 8));
+        v.day = (int) (rng() % 7) - 3;
+    }
+    for (auto &x: keys) {
+        my::EncodedKey<Visit> a(x);
+        CHECK((Visit) a == x);
+        for (auto &y: keys) sameOrder(a, my::EncodedKey<Visit>(y), x, y);
+    }
+}
+
+int main() {
+    encodedInts();
+    encodedStrings();
+    encodedComposites();
+    std::cout << "key ok\n";
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "test.h"
+#include "BPT.h"
+#include "multi_BPT.h"
+
+/*
+ * The on-disk node format (page.h), read back from the files as raw pages: a header page,
+ * then whole node pages whose headers agree with the tree (leaf entries add up to its size,
+ * no page newer than the file LSN), and opening a file in another layout is refused.
+ */
+
+using my::NodePage;
+
+template<class Tree>
+bool opens(const char *name) { //false if the tree refuses the file
+    try {
+        Tree tree(name);
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+void layout(const char *name, my::TreeKind kind, long elements) {
+    my::PreadBackend file(name);
+    CHECK(file.size() % NodePage == 0);
+    my::FileHeader header;
+    file.read(0, &header, sizeof(header));
+    CHECK(!memcmp(header.magic, "TKTTREE", 8));
+    CHECK(header.version == my::NodeFormatVersion && header.pageSize == NodePage && header.kind == kind);
+    CHECK(header.end == file.size() && header.size == elements && header.lsn > 0);
+    CHECK(header.root >= NodePage && header.root % NodePage == 0);
+    long leafEntries = 0, free = 0;
+    for (long at = NodePage; at < file.size(); at += NodePage) {
+        my::PageHeader page;
+        file.read(at, &page, sizeof(page));
+        CHECK(page.lsn <= header.lsn);
+        if (page.type == my::FreePage) ++free;
+        else if (page.type == my::LeafPage) {
+            CHECK(page.level == 0);
+            leafEntries += page.size;
+        } else CHECK(page.type == my::InternalPage && page.level > 0 && page.size > 0);
+    }
+    my::PageHeader root;
+    file.read(header.root, &root, sizeof(root));
+    CHECK(root.type == (root.level ? my::InternalPage : my::LeafPage));
+    CHECK(leafEntries == elements); //both kinds keep every element in a leaf
+    CHECK(free > 0); //the erases below merged nodes away
+}
+
+int main() {
+    freshDir();
+    {
+        my::BPT<int, int> map("map");
+        my::multiBPT<int, int> multi("multi");
+        for (int i = 0; i < 50000; ++i) {
+            map.assign(i * 7 % 50000, i);
+            multi.insert(i % 300, i);
+        }
+        for (int i = 0; i < 50000; ++i)
+            if (i % 4) {
+                map.erase(i);
+                multi.erase(i % 300, i);
+            }
+    }
+    layout("map", my::MapTree, 12500);
+    layout("multi", my::MultiMapTree, 12500);
+
+    CHECK((opens<my::BPT<int, int>>("map")));
+    CHECK(!(opens<my::BPT<int, long>>("map"))); //another value size
+    CHECK(!(opens<my::BPT<long, int>>("map"))); //another key size
+    CHECK(!(opens<my::multiBPT<int, int>>("map"))); //another tree kind
+    CHECK(!(opens<my::BPT<int, int>>("multi")));
+    {
+        my::PreadBackend junk("junk");
+        junk.write(0, "not a tree at all", 17);
+    }
+    CHECK(!(opens<my::BPT<int, int>>("junk")));
+    layout("map", my::MapTree, 12500); //a refused open leaves the file alone
+    layout("multi", my::MultiMapTree, 12500);
+    std::cout << "page ok\n";
+    return 0;
+}
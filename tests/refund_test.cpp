@@ -0,0 +1,147 @@
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <algorithm>
+#include "test.h"
+#include "trainSystem.h"
+
+/*
+ * The pending queue of TrainSystem::refund_ticket, resolved through SeatTree.
+ *
+ * refund_test is built with TICKET_SEAT_TREE_LANES=1, so every refund with a queue takes
+ * the tree; refund_reference is this file built as the program ships, with Seat only.
+ * A fixed scenario checks which queued orders a refund lets through, then a random one
+ * (a full train, a long queue of short trips, then the seats coming back a few at a time)
+ * is run by both, whose outputs must be the same.
+ */
+
+#ifdef REFUND_REFERENCE_PATH
+static_assert(N - 1 >= SeatTreeLanes, "build with TICKET_SEAT_TREE_LANES=1");
+#endif
+
+using sstring = my::string<30>;
+
+class Capture { //what TrainSystem prints while alive
+public:
+    Capture() : old(std::cout.rdbuf(out.rdbuf())) {}
+
+    ~Capture() { std::cout.rdbuf(old); }
+
+    std::string take() {
+        std::string s = out.str();
+        out.str("");
+        return s;
+    }
+
+private:
+    std::ostringstream out;
+    std::streambuf *old;
+};
+
+void addTrain(TrainSystem &system, const char *id, const std::vector<sstring> &route, int seat, const char *last) {
+    int p[N], t[N], o[N];
+    for (int j = 0; j < N; ++j) p[j] = j % 7 + 1, t[j] = 5, o[j] = 3; //a whole route fits in one day
+    sstring s[N];
+    for (size_t j = 0; j < route.size(); ++j) s[j] = route[j];
+    Train train(my::string<20>(id), (int) route.size(), seat, p, Time("00:00"), t, o, Date("06-01"), Date(last), 'G');
+    CHECK(system.add_train(train, s) == 0);
+    CHECK(system.release_train(id) == 0);
+}
+
+sstring station(int x) {
+    char b[16];
+    snprintf(b, sizeof(b), "S%d", x);
+    return sstring(b);
+}
+
+void scenario() {
+    freshDir("scenario");
+    TrainSystem system;
+    std::vector<sstring> route;
+    for (int j = 0; j < N; ++j) route.push_back(station(j));
+    addTrain(system, "long", route, 10, "06-01");
+    Capture capture;
+    int ts = 0;
+    auto buy = [&](const char *u, int n, int f, int t) {
+        system.buy_ticket(++ts, u, "long", Date("06-01"), n, std::string(route[f]), std::string(route[t]), true);
+        return capture.take();
+    };
+    auto status = [&](const char *u) {
+        system.query_order(u);
+        std::string s = capture.take();
+        return s.substr(s.find('[')); //one order each
+    };
+    CHECK(buy("a", 10, 0, N - 1) != "queue\n");
+    CHECK(buy("b", 4, 10, 20) == "queue\n");
+    CHECK(buy("c", 7, 15, 90) == "queue\n");
+    CHECK(buy("d", 7, 50, 60) == "queue\n");
+    CHECK(system.refund_ticket("a", 1) == 0); //10 seats back: b takes 4, c does not fit on 15 ~ 19, d fits
+    CHECK(status("b").rfind("[success]", 0) == 0);
+    CHECK(status("c").rfind("[pending]", 0) == 0);
+    CHECK(status("d").rfind("[success]", 0) == 0);
+    CHECK(system.refund_ticket("b", 1) == 0); //c is still short on 50 ~ 59
+    CHECK(status("c").rfind("[pending]", 0) == 0);
+    CHECK(system.refund_ticket("d", 1) == 0);
+    CHECK(status("c").rfind("[success]", 0) == 0);
+    CHECK(buy("e", 3, 0, 15) != "queue\n"); //10 - 7 left on 15 ~ 89, all 10 before
+    CHECK(buy("f", 4, 14, 16) == "queue\n");
+    std::filesystem::current_path("..");
+}
+
+void workload() { //printed to std::cout
+    const int Days = 20, Queued = 80, Users = 12;
+    std::mt19937 rng(2024);
+    TrainSystem system;
+    std::vector<sstring> route;
+    for (int j = 0; j < N; ++j) route.push_back(station(j));
+    addTrain(system, "long", route, 30, "06-20");
+    int ts = 0;
+    for (int day = 1; day <= Days; ++day) { //a full train, a queue, then seats come back a few at a time
+        char date[16], holder[16];
+        snprintf(date, sizeof(date), "06-%02d", day);
+        snprintf(holder, sizeof(holder), "h%d", day);
+        for (int i = 0; i < 6; ++i) system.buy_ticket(++ts, holder, "long", Date(date), 5, std::string(route[0]), std::string(route[N - 1]), false);
+        for (int i = 0; i < Queued; ++i) {
+            int f = (int) (rng() % (N - 1)), room = N - 1 - f; //stations after f
+            int t = f + 1 + (int) (rng() % (rng() % 4 ? std::min(room, 15) : room)); //mostly short trips
+            std::string user = "u" + std::to_string(rng() % Users);
+            system.buy_ticket(++ts, user, "long", Date(date), 1 + (int) (rng() % 8), std::string(route[f]), std::string(route[t]), true);
+        }
+        for (int i = 0; i < 6; ++i) {
+            std::cout << system.refund_ticket(holder, 1 + (int) (rng() % (6 - i))) << '\n';
+            std::string user = "u" + std::to_string(rng() % Users);
+            std::cout << system.refund_ticket(user, 1 + (int) (rng() % 4)) << '\n';
+        }
+        system.query_order(holder);
+    }
+    for (int u = 0; u < Users; ++u) system.query_order("u" + std::to_string(u));
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "workload") { //run by refund_test, in a directory of its own
+        workload();
+        return 0;
+    }
+#ifdef REFUND_REFERENCE_PATH
+    scenario();
+    freshDir("tree");
+    std::string tree;
+    {
+        Capture capture;
+        workload();
+        tree = capture.take();
+    }
+    std::filesystem::current_path("..");
+    freshDir("reference");
+    std::string reference;
+    FILE *pipe = popen(REFUND_REFERENCE_PATH " workload", "r");
+    CHECK(pipe);
+    char buf[4096];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), pipe));) reference.append(buf, n);
+    CHECK(pclose(pipe) == 0);
+    CHECK(tree.find("[pending]") != std::string::npos);
+    CHECK(tree == reference);
+    std::cout << "refund ok\n";
+#endif
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <random>
+#include <vector>
+#include "test.h"
+#include "seatRange.h"
+
+/*
+ * SeatKernel and SeatTree (seatRange.h) against a plain loop over the lanes.
+ * SeatKernel is checked on every length up to a few vector widths and every start
+ * offset, so each tail the wide steps leave is covered, with the minimum put on each lane
+ * in turn; guard lanes around the range must never change.
+ * SeatTree takes random min / modify sequences for several sizes, next to a SeatKernel array.
+ *
+ * The same file is built once per instruction set (see CMakeLists.txt): as the compiler
+ * defaults, with AVX2, and with every SIMD macro undefined for the scalar loops.
+ */
+
+constexpr int Guard = 16, MaxLen = 40, MaxOffset = 9;
+
+int scalarMin(const std::vector<int> &a, int l, int r) {
+    int tmp = INT_MAX;
+    for (int i = l; i <= r; ++i) if (a[i] < tmp) tmp = a[i];
+    return tmp;
+}
+
+void kernelTails() {
+    std::mt19937 rng(1);
+    std::vector<int> a(Guard + MaxOffset + MaxLen + Guard);
+    for (int n = 0; n <= MaxLen; ++n)
+        for (int offset = 0; offset < MaxOffset; ++offset) {
+            int l = Guard + offset, r = l + n - 1;
+            for (int at = 0; at < (n ? n : 1); ++at) { //the minimum on each lane of the range
+                for (auto &x: a) x = 1000 + (int) (rng() % 100000);
+                if (n) a[l + at] = (int) (rng() % 1000) - 500;
+                a[l - 1] = a[r + 1] = -100000; //guards below any lane in the range
+                CHECK(SeatKernel::min(a.data(), l, r) == scalarMin(a, l, r));
+                std::vector<int> b = a;
+                int add = (int) (rng() % 2001) - 1000;
+                SeatKernel::add(a.data(), l, r, add);
+                for (int i = 0; i < (int) a.size(); ++i) CHECK(a[i] == b[i] + (i >= l && i <= r ? add : 0));
+            }
+        }
+    std::vector<int> b = a;
+    CHECK(SeatKernel::min(a.data(), 20, 19) == INT_MAX); //empty range
+    SeatKernel::add(a.data(), 20, 19, 5);
+    CHECK(a == b);
+}
+
+template<int Lanes>
+void tree(int ops) {
+    std::mt19937 rng(Lanes);
+    std::vector<int> a(Lanes);
+    for (auto &x: a) x = (int) (rng() % 100000);
+    SeatTree<Lanes> t(a.data());
+    for (int i = 0; i < ops; ++i) {
+        int l = (int) (rng() % Lanes), r = (int) (rng() % Lanes);
+        if (l > r) std::swap(l, r);
+        if (rng() % 8 == 0) r = l - 1; //empty
+        switch (rng() % 5) {
+            case 0:
+            case 1:
+                CHECK(t.min(l, r) == SeatKernel::min(a.data(), l, r));
+                break;
+            case 2:
+            case 3: {
+                int add = (int) (rng() % 201) - 100;
+                t.modify(l, r, add);
+                SeatKernel::add(a.data(), l, r, add);
+                break;
+            }
+            default: {
+                std::vector<int> out(Lanes);
+                t.store(out.data());
+                CHECK(out == a);
+                if (rng() % 2) { //start over from the array
+                    for (auto &x: a) x += (int) (rng() % 3) - 1;
+                    t.load(a.data());
+                }
+            }
+        }
+    }
+    std::vector<int> out(Lanes);
+    t.store(out.data());
+    CHECK(out == a);
+    CHECK(t.min(0, Lanes - 1) == SeatKernel::min(a.data(), 0, Lanes - 1));
+}
+
+int main() {
+#if defined(__AVX2__)
+    if (!__builtin_cpu_supports("avx2")) {
+        std::cout << "no AVX2 here, skipped\n";
+        return 0;
+    }
+#endif
+    kernelTails();
+    tree<1>(200);
+    tree<2>(500);
+    tree<7>(2000);
+    tree<8>(2000);
+    tree<99>(20000);
+    tree<100>(20000);
+    tree<1000>(20000);
+    std::cout << "seat ok\n";
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <map>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "test.h"
+#include "BPT.h"
+#include "multi_BPT.h"
+#include "snapshot.h"
+
+/*
+ * my::Snapshots (snapshot.h): create, restore and delete round-trips on a BPT and a multiBPT,
+ * with snapshot_meta read back by a new process.
+ *
+ * The snapshot table is loaded when the process starts, so each phase is this program
+ * run again (with the phase as its argument) in the directory the first one prepared.
+ */
+
+using Map = my::BPT<int, int>;
+using Multi = my::multiBPT<int, int>;
+using State = std::map<int, int>;
+
+my::Snapshots &snapshots = my::Snapshots::instance();
+
+void write(Map &map, Multi &multi, const State &from, const State &to) { //the trees hold from, make them hold to
+    for (auto &p: from)
+        if (!to.count(p.first)) {
+            CHECK(map.erase(p.first));
+            CHECK(multi.erase(p.first % 50, p.first));
+        }
+    for (auto &p: to) {
+        map.assign(p.first, p.second);
+        multi.insert(p.first % 50, p.first);
+    }
+    map.flush(); //a snapshot sees only what is in the files
+    multi.flush();
+}
+
+void expect(Map &map, Multi &multi, const State &state) {
+    CHECK(map.size() == state.size());
+    CHECK(multi.size() == state.size());
+    auto it = map.begin();
+    for (auto &p: state) {
+        CHECK(it.valid() && it.key() == p.first && it.value() == p.second);
+        ++it;
+        CHECK(multi.count(p.first % 50) > 0);
+    }
+    CHECK(!it.valid());
+}
+
+void restore(Map &map, Multi &multi, const std::string &id) {
+    CHECK(snapshots.restore(id));
+    map.reload(); //every tree rereads its file
+    multi.reload();
+}
+
+State stateA() {
+    State s;
+    for (int k = 0; k < 3000; ++k) s[k] = k;
+    return s;
+}
+
+State stateB() { //odd keys of A, and 3000 more with other values
+    State s;
+    for (int k = 1; k < 3000; k += 2) s[k] = k;
+    for (int k = 3000; k < 6000; ++k) s[k] = -k;
+    return s;
+}
+
+State stateC() {
+    State s;
+    for (int k = 10000; k < 10500; ++k) s[k] = 7;
+    return s;
+}
+
+State stateD() { //A with every value changed
+    State s;
+    for (int k = 0; k < 3000; ++k) s[k] = k * 2;
+    return s;
+}
+
+void create() {
+    Map map("map");
+    Multi multi("multi");
+    write(map, multi, {}, stateA());
+    CHECK(snapshots.create("a"));
+    CHECK(!snapshots.create("a"));
+    write(map, multi, stateA(), stateB());
+    CHECK(snapshots.create("b"));
+    write(map, multi, stateB(), stateC());
+    expect(map, multi, stateC());
+    restore(map, multi, "a");
+    expect(map, multi, stateA());
+    write(map, multi, stateA(), stateD()); //restoring "a" left both snapshots in place
+}
+
+void reopen() {
+    Map map("map");
+    Multi multi("multi");
+    expect(map, multi, stateD());
+    restore(map, multi, "b");
+    expect(map, multi, stateB());
+    restore(map, multi, "a");
+    expect(map, multi, stateA());
+    CHECK(snapshots.remove("a"));
+    CHECK(!snapshots.remove("a"));
+    CHECK(!snapshots.restore("a"));
+    restore(map, multi, "b");
+    expect(map, multi, stateB());
+    CHECK(snapshots.remove("b"));
+
+    long used = my::PreadBackend("snapshot_pages").size();
+    CHECK(used > 0);
+    CHECK(snapshots.create("c")); //the pages of "a" and "b" are free again
+    write(map, multi, stateB(), stateA());
+    CHECK(my::PreadBackend("snapshot_pages").size() <= used);
+    restore(map, multi, "c");
+    expect(map, multi, stateB());
+    CHECK(snapshots.remove("c"));
+}
+
+void run(const char *phase) { //this program again, in the current directory
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        execl("/proc/self/exe", "snapshot_test", phase, (char *) nullptr);
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        std::string phase = argv[1];
+        if (phase == "create") create();
+        else if (phase == "reopen") reopen();
+        else return 2;
+        return 0;
+    }
+    freshDir();
+    run("create");
+    run("reopen");
+    std::cout << "snapshot ok\n";
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <random>
+#include <string>
+#include "test.h"
+#include "storage.h"
+
+/*
+ * The storage backends (storage.h) against a byte string: random writes that grow the
+ * file well past the first mapping, reads across and beyond the end (which see zeros),
+ * and truncation followed by growth again, which must not bring old bytes back.
+ * Files of the persistent backends are then reopened, by either backend, and must hold
+ * exactly the same bytes.
+ */
+
+using my::StorageKind;
+
+void expect(my::Storage &file, const std::string &ref, std::mt19937 &rng) {
+    CHECK(file.size() == (long) ref.size());
+    std::string buf;
+    for (long at = 0; at < (long) ref.size(); at += 4096) { //everything, a page at a time
+        size_t len = std::min<size_t>(4096, ref.size() - at);
+        buf.assign(len, '\x55');
+        file.read(at, &buf[0], len);
+        CHECK(!memcmp(buf.data(), ref.data() + at, len));
+    }
+    for (int i = 0; i < 50; ++i) { //across the end: zeros after it
+        long at = (long) (rng() % (ref.size() + 8192));
+        size_t len = 1 + rng() % 8192;
+        buf.assign(len, '\x55');
+        file.read(at, &buf[0], len);
+        for (size_t j = 0; j < len; ++j) CHECK(buf[j] == (at + (long) j < (long) ref.size() ? ref[at + j] : '\0'));
+    }
+}
+
+void write(my::Storage &file, std::string &ref, long at, size_t len, std::mt19937 &rng) {
+    std::string bytes(len, '\0');
+    for (auto &c: bytes) c = (char) (rng() % 255 + 1);
+    file.write(at, bytes.data(), len);
+    if (ref.size() < at + len) ref.resize(at + len, '\0');
+    ref.replace(at, len, bytes);
+}
+
+void test(StorageKind kind, StorageKind reopen) {
+    freshDir();
+    std::mt19937 rng(1);
+    std::string ref;
+    {
+        my::Storage file("file", kind);
+        CHECK(file.size() == 0);
+        for (int i = 0; i < 300; ++i) {
+            long at = (long) (rng() % (1 << 20));
+            if (rng() % 4 == 0) at = (long) ref.size(); //append
+            write(file, ref, at, 1 + rng() % 9000, rng);
+        }
+        expect(file, ref, rng);
+        long cut = (long) ref.size() / 3;
+        file.truncate(cut);
+        ref.resize(cut);
+        expect(file, ref, rng);
+        write(file, ref, cut + 100000, 10, rng); //the gap reads as zeros, not as the old bytes
+        write(file, ref, 5, 100, rng);
+        expect(file, ref, rng);
+        file.truncate((long) ref.size() + 10); //never grows a file
+        expect(file, ref, rng);
+    }
+    if (kind == StorageKind::Memory) return std::filesystem::current_path("..");
+    CHECK((long) std::filesystem::file_size("file") == (long) ref.size()); //no slack left behind
+    my::Storage file("file", reopen);
+    expect(file, ref, rng);
+    std::filesystem::current_path("..");
+}
+
+int main() {
+    unsetenv("TICKET_WAL"); //the backends themselves, not the log
+    test(StorageKind::Pread, StorageKind::Pread);
+    test(StorageKind::Pread, StorageKind::Mmap);
+    test(StorageKind::Mmap, StorageKind::Mmap);
+    test(StorageKind::Mmap, StorageKind::Pread);
+    test(StorageKind::Memory, StorageKind::Memory);
+    std::cout << "storage ok\n";
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef TICKET_SYSTEM_TEST_H
+#define TICKET_SYSTEM_TEST_H
+
+#include <cstdlib>
+#include <iostream>
+#include <filesystem>
+#include <string>
+
+/*
+ * helpers shared by the tests in this directory
+ *
+ * Every test runs in a directory of its own under the build tree (see CMakeLists.txt),
+ * and calls freshDir() first, so the files a run leaves behind never reach the next one.
+ */
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+        std::exit(1); \
+    } \
+} while (0)
+
+inline void freshDir(const std::string &name = "run") { //work in an empty ./name from now on
+    std::filesystem::remove_all(name);
+    std::filesystem::create_directory(name);
+    std::filesystem::current_path(name);
+}
+
+#endif //TICKET_SYSTEM_TEST_H
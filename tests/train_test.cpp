@@ -0,0 +1,77 @@
+#include <random>
+#include "test.h"
+#include "trainSystem.h"
+
+/*
+ * Train (trainSystem.h): the cumulative price and time tables against the per-segment
+ * prices, travel and stopover times they are built from, and the variable-length record
+ * kept in the train heap, which must decode to the same train for every station count.
+ */
+
+struct Segments { //what add_train is given
+    int p[N]{}, t[N]{}, o[N]{};
+};
+
+Train makeTrain(std::mt19937 &rng, int n, Segments &s) {
+    for (int j = 0; j < n - 1; ++j) s.p[j] = 1 + (int) (rng() % 100000), s.t[j] = 1 + (int) (rng() % 10000);
+    for (int j = 0; j < n - 2; ++j) s.o[j] = 1 + (int) (rng() % 10000);
+    Train train(my::string<20>("T" + std::to_string(n)), n, 1 + (int) (rng() % 100000), s.p, Time("19:19"),
+                s.t, n > 2 ? s.o : nullptr, Date("06-01"), Date("08-31"), 'D');
+    for (int j = 0; j < n; ++j) train.stations[j] = (unsigned) rng();
+    return train;
+}
+
+void tables(const Train &train, const Segments &s) {
+    int n = train.stationNum;
+    for (int l = 0; l < n - 1; ++l) {
+        long price = 0, time = 0; //from stations[l] to stations[r + 1]
+        for (int r = l; r < n - 1; ++r) {
+            price += s.p[r];
+            time += s.t[r];
+            CHECK(train.getPrice(l, r) == price);
+            CHECK(train.arrive[r + 1] - train.leave[l] == time);
+            if (r < n - 2) time += s.o[r]; //stopover at stations[r + 1]
+        }
+    }
+    CHECK(train.price[0] == 0 && train.arrive[0] == 0 && train.leave[0] == 0);
+    CHECK(train.leave[n - 1] == train.arrive[n - 1]);
+}
+
+void record(const Train &train) {
+    unsigned char buf[Train::MaxSize + 1];
+    memset(buf, 0xab, sizeof(buf));
+    train.encode(buf);
+    CHECK(train.encodedSize() <= Train::MaxSize);
+    CHECK(buf[train.encodedSize()] == 0xab); //nothing written past the record
+    Train back;
+    memset(back.price, 0x5a, sizeof(back.price)); //stale entries from an earlier train
+    memset(back.arrive, 0x5a, sizeof(back.arrive));
+    memset(back.leave, 0x5a, sizeof(back.leave));
+    back.decode(buf);
+    int n = train.stationNum;
+    CHECK(back.trainID == train.trainID && back.stationNum == n && back.seat == train.seat);
+    CHECK(back.type == train.type);
+    CHECK(!memcmp(&back.startTime, &train.startTime, sizeof(Time)));
+    CHECK(!memcmp(&back.beginDate, &train.beginDate, sizeof(Date)));
+    CHECK(!memcmp(&back.endDate, &train.endDate, sizeof(Date)));
+    for (int j = 0; j < n; ++j) {
+        CHECK(back.stations[j] == train.stations[j]);
+        CHECK(back.price[j] == train.price[j]);
+        CHECK(back.arrive[j] == train.arrive[j] && back.leave[j] == train.leave[j]);
+    }
+}
+
+int main() {
+    std::mt19937 rng(1);
+    for (int n = 2; n <= N; ++n)
+        for (int i = 0; i < 5; ++i) {
+            Segments s;
+            Train train = makeTrain(rng, n, s);
+            tables(train, s);
+            record(train);
+        }
+    Segments s;
+    CHECK(makeTrain(rng, N, s).encodedSize() == Train::MaxSize);
+    std::cout << "train ok\n";
+    return 0;
+}
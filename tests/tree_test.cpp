@@ -0,0 +1,220 @@
+#include <cstdio>
+#include <map>
+#include <set>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "test.h"
+#include "BPT.h"
+#include "multi_BPT.h"
+#include "myString.h"
+
+/*
+ * BPT and multiBPT against std::map / std::set under random writes, with an erase-heavy
+ * phase that merges most leaves away and a refill that splits them again, so slots are
+ * shifted, moved between siblings and compacted all over the tree.
+ * Each tree is run under several TreeTraits: every storage backend, both cache policies,
+ * values in leaves and in the data file, and with pinned internal nodes, on a buffer pool
+ * small enough that nodes are written back and reread all the time.
+ * Persistent backends are checked again after the files are reopened.
+ * Last, erasing most of a tree and filling it again, over and over, must reuse the
+ * freed nodes and values instead of growing the files.
+ */
+
+template<my::StorageKind S, CachePolicy C, my::ValuePlacement V, size_t Pin>
+struct Policy : my::TreeTraits {
+    static my::StorageKind storage() { return S; }
+
+    constexpr static CachePolicy cache = C;
+
+    constexpr static size_t pinPages = Pin;
+
+    constexpr static my::ValuePlacement values = V;
+};
+
+struct Val { //large enough that Auto keeps it in the data file
+    int x = 0;
+    char pad[300]{};
+
+    Val() = default;
+
+    explicit Val(int v) : x(v) { pad[299] = (char) v; }
+
+    bool is(int v) const { return x == v && pad[299] == (char) v; }
+};
+
+using Name = my::string<20>;
+
+Name nameOf(int x) {
+    char b[24];
+    snprintf(b, sizeof(b), "n%07d", x);
+    return Name(b);
+}
+
+template<class Map>
+void checkMap(Map &map, const std::map<int, int> &ref, int range, std::mt19937 &rng) {
+    CHECK(map.size() == ref.size());
+    for (int x = 0; x < range; ++x) {
+        Val v;
+        auto it = ref.find(x);
+        CHECK(map.find(x, v) == (it != ref.end()));
+        if (it != ref.end()) CHECK(v.is(it->second));
+    }
+    auto it = map.begin();
+    for (auto &p: ref) {
+        CHECK(it.valid() && it.key() == p.first && it.value().is(p.second));
+        ++it;
+    }
+    CHECK(!it.valid());
+    auto rt = --map.end();
+    for (auto p = ref.rbegin(); p != ref.rend(); ++p, --rt) CHECK(rt.valid() && rt.key() == p->first);
+    CHECK(!rt.valid());
+    for (int i = 0; i < 200; ++i) {
+        int x = (int) (rng() % (range + 2)) - 1;
+        auto lb = map.lowerBound(x);
+        auto p = ref.lower_bound(x);
+        CHECK(lb.valid() == (p != ref.end()));
+        if (p != ref.end()) CHECK(lb.key() == p->first);
+    }
+}
+
+template<class Traits>
+void testMap(bool persistent) {
+    freshDir();
+    using Map = my::BPT<int, Val, Traits>;
+    std::mt19937 rng(1);
+    std::map<int, int> ref;
+    const int Range = 6000;
+    {
+        Map map("map");
+        for (int i = 0; i < 20000; ++i) {
+            int x = (int) (rng() % Range);
+            if (rng() % 3) {
+                map.assign(x, Val(i));
+                ref[x] = i;
+            } else CHECK(map.erase(x) == (ref.erase(x) > 0));
+        }
+        checkMap(map, ref, Range, rng);
+        for (int x = 0; x < Range; ++x) //erase-heavy: leaves drop to a handful of entries
+            if (x % 23) CHECK(map.erase(x) == (ref.erase(x) > 0));
+        checkMap(map, ref, Range, rng);
+        for (int x = Range - 1; x >= 0; --x) //refill from the right end
+            if (rng() % 2) {
+                map.assign(x, Val(-x));
+                ref[x] = -x;
+            }
+        checkMap(map, ref, Range, rng);
+    }
+    if (!persistent) return std::filesystem::current_path("..");
+    Map map("map");
+    checkMap(map, ref, Range, rng);
+    std::filesystem::current_path("..");
+}
+
+template<class Multi>
+void checkMulti(Multi &multi, const std::set<std::pair<int, int>> &ref, int range) {
+    CHECK(multi.size() == ref.size());
+    for (int x = 0; x < range; ++x) {
+        sjtu::vector<int> out;
+        multi.find(nameOf(x), out);
+        size_t c = 0;
+        for (auto p = ref.lower_bound({x, INT32_MIN}); p != ref.end() && p->first == x; ++p, ++c)
+            CHECK(c < out.size() && out[c] == p->second);
+        CHECK(c == out.size());
+    }
+    auto it = multi.begin();
+    for (auto &p: ref) {
+        CHECK(it.valid() && it.key() == nameOf(p.first) && it.value() == p.second);
+        ++it;
+    }
+    CHECK(!it.valid());
+}
+
+template<class Traits>
+void testMulti(bool persistent) {
+    freshDir();
+    using Multi = my::multiBPT<Name, int, Traits>;
+    std::mt19937 rng(2);
+    std::set<std::pair<int, int>> ref;
+    const int Range = 400;
+    {
+        Multi multi("multi");
+        for (int i = 0; i < 30000; ++i) {
+            int x = (int) (rng() % Range), v = (int) (rng() % 200);
+            if (rng() % 3) {
+                multi.insert(nameOf(x), v);
+                ref.insert({x, v});
+            } else CHECK(multi.erase(nameOf(x), v) == (ref.erase({x, v}) > 0));
+        }
+        checkMulti(multi, ref, Range);
+        for (auto p = ref.begin(); p != ref.end();) //erase-heavy
+            if (p->second % 17) {
+                CHECK(multi.erase(nameOf(p->first), p->second));
+                p = ref.erase(p);
+            } else ++p;
+        checkMulti(multi, ref, Range);
+        for (int i = 0; i < 20000; ++i) {
+            int x = (int) (rng() % Range), v = (int) (rng() % 200);
+            multi.insert(nameOf(x), v);
+            ref.insert({x, v});
+        }
+        checkMulti(multi, ref, Range);
+    }
+    if (!persistent) return std::filesystem::current_path("..");
+    Multi multi("multi");
+    checkMulti(multi, ref, Range);
+    std::filesystem::current_path("..");
+}
+
+void spaceReuse() {
+    freshDir();
+    using Traits = Policy<my::StorageKind::Pread, CachePolicy::LRU, my::ValuePlacement::External, 0>;
+    my::BPT<int, Val, Traits> map("map");
+    my::multiBPT<Name, int> multi("multi");
+    std::mt19937 rng(3);
+    const int Keys = 8000;
+    std::vector<int> keys(Keys);
+    for (int i = 0; i < Keys; ++i) keys[i] = i;
+    long nodes = 0, values = 0, multiNodes = 0;
+    for (int cycle = 0; cycle < 6; ++cycle) {
+        std::shuffle(keys.begin(), keys.end(), rng);
+        for (int x: keys) {
+            map.assign(x, Val(x));
+            multi.insert(nameOf(x % 500), x);
+        }
+        map.flush();
+        multi.flush();
+        long n = my::PreadBackend("map").size(), v = my::PreadBackend("map_dataFile").size();
+        long m = my::PreadBackend("multi").size();
+        if (!cycle) nodes = n, values = v, multiNodes = m;
+        CHECK(v == values); //one value slot per key, all of them taken back
+        CHECK(n <= nodes + nodes / 4 && m <= multiNodes + multiNodes / 4); //splits may fall a little differently
+        for (int i = 0; i < Keys - 10; ++i) { //not all of them: an empty tree starts over anyway
+            CHECK(map.erase(keys[i]));
+            CHECK(multi.erase(nameOf(keys[i] % 500), keys[i]));
+        }
+    }
+    std::filesystem::current_path("..");
+}
+
+template<my::StorageKind S, CachePolicy C, my::ValuePlacement V, size_t Pin>
+void run() {
+    using Traits = Policy<S, C, V, Pin>;
+    testMap<Traits>(S != my::StorageKind::Memory);
+    testMulti<Traits>(S != my::StorageKind::Memory);
+}
+
+int main() {
+    using my::StorageKind;
+    using my::ValuePlacement;
+    BufferPool::instance().setBudget(24);
+    run<StorageKind::Pread, CachePolicy::LRU, ValuePlacement::Auto, 0>();
+    run<StorageKind::Pread, CachePolicy::TwoQ, ValuePlacement::Inline, 0>();
+    run<StorageKind::Mmap, CachePolicy::TwoQ, ValuePlacement::External, 8>();
+    run<StorageKind::Mmap, CachePolicy::LRU, ValuePlacement::Inline, 4>();
+    run<StorageKind::Memory, CachePolicy::LRU, ValuePlacement::External, 0>();
+    run<StorageKind::Memory, CachePolicy::TwoQ, ValuePlacement::Auto, 8>();
+    spaceReuse();
+    std::cout << "tree ok\n";
+    return 0;
+}
@@ -0,0 +1,197 @@
+#include <cstdlib>
+#include <map>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "test.h"
+#include "BPT.h"
+#include "multi_BPT.h"
+
+/*
+ * Crash recovery of my::Wal (storage.h), built with a small WAL_CHECKPOINT_BYTES so that
+ * fuzzy checkpoints start and drain while the test runs.
+ *
+ * Every phase runs in a child process: the first Wal::instance() of a process is what
+ * recovers the log, and _exit() leaves without destructors, caches or a final commit,
+ * which is what a crash looks like to the files. Each phase checks the trees against
+ * what the groups committed so far should hold.
+ */
+
+using Map = my::BPT<int, int>;
+using Multi = my::multiBPT<int, int>;
+
+template<class F>
+void phase(F f) { //run f in a child, which must exit with 0
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        f();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+void crash() { _exit(0); } //no destructors: nothing reaches the files after this point
+
+void commit(Map &map, Multi &multi) { //one group, as main does it
+    map.flush();
+    multi.flush();
+    my::Wal::instance().commit();
+}
+
+void expect(Map &map, Multi &multi, int groups, int perGroup) { //groups 0 ~ groups - 1 are in
+    CHECK(map.size() == (size_t) groups * perGroup);
+    CHECK(multi.size() == (size_t) groups * perGroup * 2);
+    for (int g = 0; g < groups + 2; ++g)
+        for (int i = 0; i < perGroup; ++i) {
+            int k = g * perGroup + i, v;
+            CHECK(map.find(k, v) == (g < groups));
+            if (g < groups) CHECK(v == k * 3);
+            CHECK(multi.count(k % 97) >= (g < groups ? 1u : 0u));
+        }
+}
+
+void write(Map &map, Multi &multi, int g, int perGroup) {
+    for (int i = 0; i < perGroup; ++i) {
+        int k = g * perGroup + i;
+        map.assign(k, k * 3);
+        multi.insert(k % 97, k);
+        multi.insert(k % 97, -k - 1);
+    }
+}
+
+long segmentSeq(const char *name) { //seq in the first record of a segment, 0 if empty
+    my::PreadBackend segment(name);
+    long head[2] = {0, 0};
+    if (segment.size() >= (long) sizeof(head)) segment.read(0, head, sizeof(head));
+    return head[1];
+}
+
+void committedGroupsSurvive() {
+    const int Groups = 12, PerGroup = 1500; //enough pages to pass WAL_CHECKPOINT_BYTES a few times
+    phase([&] {
+        Map map("map");
+        Multi multi("multi");
+        for (int g = 0; g < Groups; ++g) {
+            write(map, multi, g, PerGroup);
+            commit(map, multi);
+        }
+        write(map, multi, Groups, PerGroup); //logged, never committed
+        map.flush();
+        multi.flush();
+        crash();
+    });
+    phase([&] {
+        Map map("map");
+        Multi multi("multi");
+        expect(map, multi, Groups, PerGroup);
+        write(map, multi, Groups, PerGroup);
+        commit(map, multi);
+        crash();
+    });
+    phase([&] { //recovered twice in a row: the redo is idempotent
+        Map map("map");
+        Multi multi("multi");
+        expect(map, multi, Groups + 1, PerGroup);
+    });
+}
+
+void tornTailIsIgnored() {
+    const int Groups = 4, PerGroup = 500;
+    phase([&] {
+        Map map("map");
+        Multi multi("multi");
+        for (int g = 0; g < Groups; ++g) {
+            write(map, multi, g, PerGroup);
+            commit(map, multi);
+        }
+        crash();
+    });
+    { //cut the commit record of the last group in the newer segment
+        const char *newer = segmentSeq("wal_0") > segmentSeq("wal_1") ? "wal_0" : "wal_1";
+        my::PreadBackend segment(newer);
+        CHECK(segment.size() > 16);
+        segment.truncate(segment.size() - 16);
+    }
+    phase([&] {
+        Map map("map");
+        Multi multi("multi");
+        expect(map, multi, Groups - 1, PerGroup);
+    });
+}
+
+void closingAFileDoesNotCommit() {
+    const int PerGroup = 300;
+    phase([&] {
+        Map map("map");
+        Multi multi("multi");
+        write(map, multi, 0, PerGroup);
+        commit(map, multi);
+        { //a tree closed in the middle of a group
+            my::BPT<int, int> other("other");
+            for (int k = 0; k < PerGroup; ++k) other.assign(k, -k);
+            map.assign(-1, 1); //same group, not committed either
+        }
+        {
+            my::BPT<int, int> other("other"); //reopened before any checkpoint: its pages are still in the log
+            CHECK(other.size() == (size_t) PerGroup);
+            CHECK(other[PerGroup - 1] == 1 - PerGroup);
+        }
+        map.flush();
+        crash();
+    });
+    phase([&] {
+        Map map("map");
+        Multi multi("multi");
+        expect(map, multi, 1, PerGroup);
+        CHECK(!map.count(-1));
+        my::BPT<int, int> other("other");
+        CHECK(other.empty());
+        for (int k = 0; k < PerGroup; ++k) other.assign(k, -k);
+        other.flush();
+        my::Wal::instance().commit();
+        crash();
+    });
+    phase([&] {
+        my::BPT<int, int> other("other");
+        CHECK(other.size() == (size_t) PerGroup);
+        for (int k = 0; k < PerGroup; ++k) CHECK(other[k] == -k);
+    });
+}
+
+void shutdownLeavesTheLogEmpty() {
+    const int PerGroup = 400;
+    phase([&] {
+        {
+            Map map("map");
+            Multi multi("multi");
+            write(map, multi, 0, PerGroup);
+            commit(map, multi);
+            write(map, multi, 1, PerGroup);
+        } //closing writes back the caches, nothing is committed yet
+        my::Wal::instance().shutdown(); //commits group 1 too
+        std::exit(0); //a normal exit, the Wal marks the log clean
+    });
+    CHECK(my::PreadBackend("wal_0").size() == 0);
+    CHECK(my::PreadBackend("wal_1").size() == 0);
+    long marker = 0;
+    my::PreadBackend("wal").read(0, &marker, sizeof(long));
+    CHECK(marker == 0x434c45414e); //Clean
+    phase([&] {
+        Map map("map");
+        Multi multi("multi");
+        expect(map, multi, 2, PerGroup);
+    });
+}
+
+int main() {
+    setenv("TICKET_WAL", "1", 1); //before the first Storage of any process
+    for (auto test: {committedGroupsSurvive, tornTailIsIgnored, closingAFileDoesNotCommit, shutdownLeavesTheLogEmpty}) {
+        freshDir();
+        test();
+        std::filesystem::current_path("..");
+    }
+    std::cout << "wal ok\n";
+    return 0;
+}